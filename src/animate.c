@@ -32,6 +32,16 @@
 #include <stdlib.h>
 #include <string.h>
 #include "joint.h"
+#include "blend.h"
+#include "clip.h"
+#include "ik.h"
+#include "kinematics.h"
+#include "rng.h"
+
+/* the number of animations, and how long changing from one to another
+ * takes, in frames */
+#define ANIMATIONS (ANIM_CLIP + 1)
+#define ANIM_FADE ((int)(ROBOT_FRAMES_PER_S / 2))
 
 /* the animation type that is currently running */
 static enum animation animation = ANIM_STANDBY;
@@ -41,8 +51,60 @@ static enum animation animation = ANIM_STANDBY;
  * in anim_think */
 int anim_seq;
 
-/* contains the current animation state -- where the joint is moving to */
-static joint_info anim_state[JOINTCOUNT];
+/* the frame being drawn: the ticks are a fixed length, and the screen is
+ * drawn between them, anim_time - anim_seq + 1 of the way from the last
+ * to the latest.  Set by animate_lerp */
+float anim_time;
+
+/* the joint angles before the latest tick, to draw from */
+static joint_pose last;
+
+/* contains the current animation state -- a layer for each animation,
+ * then one for each overlay.  Each holds where that animation wants the
+ * joints, and which of them it moves; the others (the body's global 
+ * rotation while flying, say) are left to the user.  The layers of the
+ * animation being changed from and to are mixed while they fade. */
+static blend_layer layers[ANIMATIONS + OVERLAYS];
+
+/* the animation routines fill in target, their layer's pose */
+#define TARGET_X(j) (target->rot[AXIS_X][j])
+#define TARGET_Y(j) (target->rot[AXIS_Y][j])
+
+/* the arm reaching for a point (relative to the robot), or -1, and the
+ * reach's fade.  It is worked out over whatever the layers mix to, so 
+ * the arm reaches the same from any animation. */
+static int reach_limb = -1;
+static float reach_target[3];
+static blend_layer reach;
+
+/* the library clip ANIM_CLIP plays, and the frame it started on */
+static int playing = -1;
+static int clip_start;
+
+/* the joints as they were after each tick of the recording, if one is
+ * running; animate_record_save makes a clip of them.  A recording stops
+ * growing after ANIM_RECORD_MAX keys. */
+#define ANIM_RECORD_MAX ((int)(5 * 60 * ROBOT_FRAMES_PER_S))
+static joint_pose *recorded = NULL;
+static int recorded_keys = 0;
+static int recorded_room = 0;
+static int recording = 0;
+
+/* the channels in a pose: every angle, counting the padding slots */
+#define POSE_CHANNELS (JOINT_AXES * JOINT_SLOTS)
+
+/* a layer's loops, baked by init_animation: for each channel they set, 
+ * its value every frame of their period, one channel after another */
+typedef struct {
+	int frames;
+	int channels;
+	uint8_t channel[POSE_CHANNELS];
+	float *table;
+} baked_loops;
+static baked_loops baked[ANIMATIONS + OVERLAYS];
+
+/* the random numbers for the random animation loops */
+static rng_t anim_rng;
 
 /* the sine animation loop */
 static float sineloop(float amplitude, float period, float phase) {
@@ -55,7 +117,7 @@ static float randloop(float now, float max, float min, float amplitude, float pe
 	if ( anim_seq % (int)period != 0 )
 		return now;
 	//printf("now org = %f", now);
-	float rndval = (((float)rand())/((float)RAND_MAX) - 0.5);
+	float rndval = rng_float(&anim_rng) - 0.5;
 	now = now + rndval * amplitude;
 	//printf(" now rnd=%f scaled rnd=%f", now, rndval * amplitude); 
 	if ( now > max )
@@ -77,191 +139,403 @@ static float sawloop(float amplitude, float period) {
 	return val * amplitude * 2.0;
 }
 
-/* the standby animation sequence */
-static void standby(void) {
+/* turns the reaching arm in target towards the reach's point, as far as
+ * the reach is faded in, and adds the angles it turns to mask.  Their 
+ * speeds go over to the reach's the same way. */
+static void reach_for(joint_pose *target, joint_pose *speed, 
+		joint_mask *mask) {
+	joint_pose solved = *target;
+	const float *s = solved.rot[0];
+	float *t = target->rot[0];
+	float *v = speed->rot[0];
+	uint32_t *on = mask->on[0];
+	int c;
+
+	ik_reach(&solved, reach_limb, reach_target);
+	for ( c = 0; c < POSE_CHANNELS; c++ )
+		if ( s[c] != t[c] ) {
+			t[c] += (s[c] - t[c]) * reach.fade;
+			if ( on[c] )
+				v[c] += (reach.speed - v[c]) * reach.fade;
+			else
+				v[c] = reach.speed;
+			on[c] = ~0u;
+		}
 }
 
-/* a method that moves all of the joints towards where they should be for 
- * animation.  Returns 0 when no change occured. */
-static int move_joints(float speed) {
-	int i;
-	int changed = 0;
-	
-	for(i=0; i<JOINTCOUNT; i++) {
-		changed |= joint_s_place(
-			i, 
-			speed,
-			anim_state[i].xrot,
-			anim_state[i].yrot,
-			anim_state[i].zrot
-		);
-	}
+/* a method that moves all of the joints the faded in layers use towards
+ * where they should be.  Returns 0 when no change occured. */
+static int move_joints(void) {
+	joint_pose target, speed;
+	joint_mask mask;
 
-	return changed;
+	blend_mix(&target, &speed, &mask, &joint_angles, layers, 
+		ANIMATIONS + OVERLAYS);
+	if ( reach_limb >= 0 && reach.fade > 0 )
+		reach_for(&target, &speed, &mask);
+	return joint_pose_step(&joint_angles, &target, &mask, &speed);
 }
 
 /* Re-sets the animation state */
-static void clear_animations(void) {
-	extern joint_info joints_base[JOINTCOUNT];
-	memcpy(anim_state, joints_base, sizeof(joint_info) * JOINTCOUNT);
+static void clear_animations(joint_pose *target) {
+	joint_base_pose(target);
 }
 
 /* Starts the reset animation */
-static void start_reset(void) {
-	clear_animations();
+static void start_reset(joint_pose *target) {
+	clear_animations(target);
 }
 
-/* Runs the reset animation */
-static void reset(void) {
-	int changed;
-	
-	changed = move_joints(0.8);
-	
-	if ( !changed ) 
-		animation = ANIM_STANDBY;
+/* starts the flying animation */
+static void start_fly(joint_pose *target) {
+	clear_animations(target);
+	TARGET_X(SL_L_UPPERARM) = -15;
+	TARGET_Y(SL_L_UPPERARM) = -45;
+	TARGET_X(SL_R_UPPERARM) = -15;
+	TARGET_Y(SL_R_UPPERARM) = 45;
+	TARGET_Y(SL_R_FOREARM) = 0;
+	TARGET_Y(SL_R_FOREARM) = 0;
+	TARGET_X(SL_R_FINGERS) = 0;
+	TARGET_Y(SL_R_FINGERS) = 0;
+	TARGET_Y(SL_L_UPPERLEG) = 45;
+	TARGET_Y(SL_R_UPPERLEG) = 45;
+	TARGET_Y(SL_L_LOWERLEG) = 90;
+	TARGET_Y(SL_R_LOWERLEG) = 90;
+	TARGET_Y(SL_L_FOOT) = 45;
+	TARGET_Y(SL_R_FOOT) = 45;
+	TARGET_Y(SL_CAMERA) = 40;
+	TARGET_Y(SL_HEADLIGHTS) = 5;
+	TARGET_Y(SL_L_THRUSTER) = -15;
+	TARGET_Y(SL_R_THRUSTER) = -15;
+	TARGET_X(SL_L_SOLARPANEL) = 45;
+	TARGET_Y(SL_L_SOLARPANEL) = -15;
+	TARGET_X(SL_R_SOLARPANEL) = -45;
+	TARGET_Y(SL_R_SOLARPANEL) = 15;
 }
 
-/* starts the flying animation */
-static void start_fly(void) {
-	clear_animations();
-	anim_state[SL_L_UPPERARM].xrot = -15;
-	anim_state[SL_L_UPPERARM].yrot = -45;
-	anim_state[SL_R_UPPERARM].xrot = -15;
-	anim_state[SL_R_UPPERARM].yrot = 45;
-	anim_state[SL_R_FOREARM].yrot = 0;
-	anim_state[SL_R_FOREARM].yrot = 0;
-	anim_state[SL_R_FINGERS].xrot = 0;
-	anim_state[SL_R_FINGERS].yrot = 0;
-	anim_state[SL_L_UPPERLEG].yrot = 45;
-	anim_state[SL_R_UPPERLEG].yrot = 45;
-	anim_state[SL_L_LOWERLEG].yrot = 90;
-	anim_state[SL_R_LOWERLEG].yrot = 90;
-	anim_state[SL_L_FOOT].yrot = 45;
-	anim_state[SL_R_FOOT].yrot = 45;
-	anim_state[SL_CAMERA].yrot = 40;
-	anim_state[SL_HEADLIGHTS].yrot = 5;
-	anim_state[SL_L_THRUSTER].yrot = -15;
-	anim_state[SL_R_THRUSTER].yrot = -15;
-	anim_state[SL_L_SOLARPANEL].xrot = 45;
-	anim_state[SL_L_SOLARPANEL].yrot = -15;
-	anim_state[SL_R_SOLARPANEL].xrot = -45;
-	anim_state[SL_R_SOLARPANEL].yrot = 15;
-}
-
-/* Runs the flying animation */
-static void fly(void) {
-	/* don't override global rotations */
-	anim_state[SL_BODY].xrot = X_ROT(SL_BODY);
-	anim_state[SL_BODY].yrot = Y_ROT(SL_BODY);
-	anim_state[SL_L_UPPERARM].xrot = -15 + sineloop(15, 3, 0);
-	anim_state[SL_R_UPPERARM].xrot = -15 + sineloop(15, 3, 0);
-	anim_state[SL_L_WRIST].yrot = sineloop(40, 3, 0);
-	anim_state[SL_R_WRIST].yrot = sineloop(40, 3, 0);
-	anim_state[SL_CAMERA].xrot = sawloop(40, 0.2)+20;
-	anim_state[SL_HEADLIGHTS].xrot = sawloop(360, 1) + 180;
-	anim_state[SL_L_FOOT].yrot = randloop(anim_state[SL_L_FOOT].yrot, 45, 10, 20, 0.05);
-	anim_state[SL_R_FOOT].yrot = randloop(anim_state[SL_R_FOOT].yrot, 45, 10, 20, 0.05);
-	anim_state[SL_L_FOOT].xrot = randloop(anim_state[SL_L_FOOT].xrot, 20, -20, 20, 0.05);
-	anim_state[SL_R_FOOT].xrot = randloop(anim_state[SL_R_FOOT].xrot, 20, -20, 20, 0.05);
- 	anim_state[SL_L_SOLARPANEL].yrot = randloop(anim_state[SL_L_SOLARPANEL].yrot, 0, -30, 10, 0.1);
-	anim_state[SL_R_SOLARPANEL].yrot = randloop(anim_state[SL_R_SOLARPANEL].yrot, 30, 0, 10, 0.1);
-	move_joints(2);
+/* Runs the flying animation's loops */
+static void fly_loops(joint_pose *target) {
+	TARGET_X(SL_L_UPPERARM) = -15 + sineloop(15, 3, 0);
+	TARGET_X(SL_R_UPPERARM) = -15 + sineloop(15, 3, 0);
+	TARGET_Y(SL_L_WRIST) = sineloop(40, 3, 0);
+	TARGET_Y(SL_R_WRIST) = sineloop(40, 3, 0);
+	TARGET_X(SL_CAMERA) = sawloop(40, 0.2)+20;
+	TARGET_X(SL_HEADLIGHTS) = sawloop(360, 1) + 180;
+}
+
+/* Runs the rest of the flying animation: the random 'loops', which carry
+ * on from where they were rather than repeating, so aren't baked */
+static void fly(joint_pose *target) {
+	TARGET_Y(SL_L_FOOT) = randloop(TARGET_Y(SL_L_FOOT), 45, 10, 20, 0.05);
+	TARGET_Y(SL_R_FOOT) = randloop(TARGET_Y(SL_R_FOOT), 45, 10, 20, 0.05);
+	TARGET_X(SL_L_FOOT) = randloop(TARGET_X(SL_L_FOOT), 20, -20, 20, 0.05);
+	TARGET_X(SL_R_FOOT) = randloop(TARGET_X(SL_R_FOOT), 20, -20, 20, 0.05);
+ 	TARGET_Y(SL_L_SOLARPANEL) = randloop(TARGET_Y(SL_L_SOLARPANEL), 0, -30, 10, 0.1);
+	TARGET_Y(SL_R_SOLARPANEL) = randloop(TARGET_Y(SL_R_SOLARPANEL), 30, 0, 10, 0.1);
 }
 
 /* Starts the dancing animation */
-static void start_dance(void) {
-	clear_animations();
+static void start_dance(joint_pose *target) {
+	clear_animations(target);
 }
 
-/* Runs the dancing animation */
-static void dance(void) {
-	/* don't override global rotations */
-	anim_state[SL_BODY].xrot = X_ROT(SL_BODY);
-	anim_state[SL_BODY].yrot = Y_ROT(SL_BODY);
-	anim_state[SL_R_FINGERS].xrot = sineloop(45, 5, 0);
-	anim_state[SL_HEADLIGHTS].yrot = sineloop(90, 5, 0)+45;
-	anim_state[SL_HEADLIGHTS].xrot = sawloop(360, 3) + 180;
-	anim_state[SL_CAMERA].yrot = sineloop(40, 5, 0)+40;
-	anim_state[SL_L_TOES].yrot = sineloop(40, 5, 0);
-	anim_state[SL_R_FOREARM].yrot = 90 + sineloop(10, 5, -M_PI/2-0.4);
-	anim_state[SL_L_THRUSTER].yrot = sineloop(10, 5, 0);
-	anim_state[SL_R_THRUSTER].yrot = sineloop(10, 5, 0);
-	move_joints(5);
+/* Runs the dancing animation's loops */
+static void dance_loops(joint_pose *target) {
+	TARGET_X(SL_R_FINGERS) = sineloop(45, 5, 0);
+	TARGET_Y(SL_HEADLIGHTS) = sineloop(90, 5, 0)+45;
+	TARGET_X(SL_HEADLIGHTS) = sawloop(360, 3) + 180;
+	TARGET_Y(SL_CAMERA) = sineloop(40, 5, 0)+40;
+	TARGET_Y(SL_L_TOES) = sineloop(40, 5, 0);
+	TARGET_Y(SL_R_FOREARM) = 90 + sineloop(10, 5, -M_PI/2-0.4);
+	TARGET_Y(SL_L_THRUSTER) = sineloop(10, 5, 0);
+	TARGET_Y(SL_R_THRUSTER) = sineloop(10, 5, 0);
 }
 
 /* Starts the walking animation */
-static void start_walk(void) {
-	clear_animations();
-	anim_state[SL_CAMERA].yrot = 30;
-	anim_state[SL_HEADLIGHTS].yrot = 25;
-	anim_state[SL_L_UPPERARM].yrot = -90;
-	anim_state[SL_R_UPPERARM].yrot = 90;
-	anim_state[SL_R_FOREARM].yrot = 0;
+static void start_walk(joint_pose *target) {
+	clear_animations(target);
+	TARGET_Y(SL_CAMERA) = 30;
+	TARGET_Y(SL_HEADLIGHTS) = 25;
+	TARGET_Y(SL_L_UPPERARM) = -90;
+	TARGET_Y(SL_R_UPPERARM) = 90;
+	TARGET_Y(SL_R_FOREARM) = 0;
 }
 
-/* Runs the walking animation */
-static void walk(void) {
-	/* don't override global rotations */
-	anim_state[SL_BODY].xrot = X_ROT(SL_BODY);
-	anim_state[SL_BODY].yrot = Y_ROT(SL_BODY);
-	anim_state[SL_L_UPPERLEG].yrot = -sineloop(22.5, 2, 0) - 22.5;
-	anim_state[SL_L_LOWERLEG].yrot = sineloop(22.5, 2, 0) + 22.5;
-	anim_state[SL_R_UPPERLEG].yrot = -sineloop(22.5, 2, M_PI/2) - 22.5;
-	anim_state[SL_R_LOWERLEG].yrot = sineloop(22.5, 2, M_PI/2) + 22.5;
-	anim_state[SL_R_TOES].yrot = sineloop(22, 2, 0) -22;
-	anim_state[SL_L_TOES].yrot = sineloop(22, 2, M_PI/2) -22;
-	anim_state[SL_BODY].xrot = sineloop(10, 2, 0);
-	anim_state[SL_CAMERA].xrot = -sineloop(10, 2, 0);
-	anim_state[SL_HEADLIGHTS].xrot = -sineloop(10, 2, 0);
-	anim_state[SL_R_FINGERS].xrot = sineloop(45, 10, 0);
-	anim_state[SL_L_FINGERS].xrot = sineloop(45, 10, 0);
-	move_joints(2);
+/* Runs the walking animation's loops */
+static void walk_loops(joint_pose *target) {
+	TARGET_Y(SL_L_UPPERLEG) = -sineloop(22.5, 2, 0) - 22.5;
+	TARGET_Y(SL_L_LOWERLEG) = sineloop(22.5, 2, 0) + 22.5;
+	TARGET_Y(SL_R_UPPERLEG) = -sineloop(22.5, 2, M_PI/2) - 22.5;
+	TARGET_Y(SL_R_LOWERLEG) = sineloop(22.5, 2, M_PI/2) + 22.5;
+	TARGET_Y(SL_R_TOES) = sineloop(22, 2, 0) -22;
+	TARGET_Y(SL_L_TOES) = sineloop(22, 2, M_PI/2) -22;
+	TARGET_X(SL_BODY) = sineloop(10, 2, 0);
+	TARGET_X(SL_CAMERA) = -sineloop(10, 2, 0);
+	TARGET_X(SL_HEADLIGHTS) = -sineloop(10, 2, 0);
+	TARGET_X(SL_R_FINGERS) = sineloop(45, 10, 0);
+	TARGET_X(SL_L_FINGERS) = sineloop(45, 10, 0);
 }
 
-/* Progresses the animation state 1 frame */
-void animate_think(void) {
-	anim_seq++;
-	switch(animation) {
-		case ANIM_STANDBY:
-			standby();
-			break;
-		case ANIM_RESET:
-			reset();
-			break;
+/* Starts playing a clip from the library */
+static void start_clip(joint_pose *target) {
+	const clip_t *clip = clip_get(playing);
+
+	clip_start = anim_seq;
+	clip_sample(clip, 0, target);
+	layers[ANIM_CLIP].weight = clip->head->weight;
+}
+
+/* Plays the clip on from where it is up to */
+static void play_clip(joint_pose *target) {
+	const clip_t *clip = clip_get(playing);
+
+	/* a snapshot's clip may not be in this library */
+	if ( clip )
+		clip_sample(clip, (anim_seq - clip_start) / ROBOT_FRAMES_PER_S,
+			target);
+}
+
+/* Runs the waving overlay: the right arm goes up, and the forearm swings
+ * from side to side, on top of whatever the animation has it doing */
+static void wave_loops(joint_pose *target) {
+	TARGET_X(SL_R_UPPERARM) = -135;
+	TARGET_Y(SL_R_FOREARM) = -30 + sineloop(30, 10, 0);
+}
+
+/* works out layer's loops, at the current frame */
+static void work_loops(int layer, joint_pose *target) {
+	switch(layer) {
 		case ANIM_FLY:
-			fly();
+			fly_loops(target);
 			break;
 		case ANIM_DANCE:
-			dance();
+			dance_loops(target);
 			break;
 		case ANIM_WALK:
-			walk();
+			walk_loops(target);
 			break;
+		case ANIMATIONS + OVERLAY_WAVE:
+			wave_loops(target);
+			break;
+	}
+}
+
+/* Bakes layer's loops, which repeat every frames frames, into a table 
+ * of each channel they set, a frame at a time.  Falls back to working
+ * them out if it can't. */
+static void bake_loops(int layer, int frames) {
+	baked_loops *b = &baked[layer];
+	joint_pose key;
+	float *k = key.rot[0];
+	int seq = anim_seq;
+	int f, c, n;
+
+	/* the channels the loops set are the ones they don't leave not a 
+	 * number */
+	for ( c = 0; c < POSE_CHANNELS; c++ )
+		k[c] = NAN;
+	work_loops(layer, &key);
+	b->channels = 0;
+	for ( c = 0; c < POSE_CHANNELS; c++ )
+		if ( !isnan(k[c]) )
+			b->channel[b->channels++] = c;
+
+	free(b->table);
+	b->table = malloc(sizeof(float) * b->channels * frames);
+	if ( !b->table ) {
+		printf("%s %d:  can't bake animation %d\n", __FILE__, __LINE__,
+			layer);
+		b->frames = 0;
+		return;
+	}
+	b->frames = frames;
+	for ( f = 0; f < frames; f++ ) {
+		anim_seq = f;
+		work_loops(layer, &key);
+		for ( n = 0; n < b->channels; n++ )
+			b->table[n * frames + f] = k[b->channel[n]];
+	}
+	anim_seq = seq;
+}
+
+/* Runs layer's loops, from the table if they are baked */
+static void loops(int layer, joint_pose *target) {
+	const baked_loops *b = &baked[layer];
+	float *to = target->rot[0];
+	const float *from;
+	int n;
+
+	if ( !b->frames ) {
+		work_loops(layer, target);
+		return;
+	}
+	from = b->table + anim_seq % b->frames;
+	for ( n = 0; n < b->channels; n++ )
+		to[b->channel[n]] = from[n * b->frames];
+}
+
+/* Initializes the animation state.  Call after the seed is set. */
+void init_animation(void) {
+	joint_mask mask;
+	int i;
+
+	rng_stream(&anim_rng, rng_get_seed(), RNG_ANIMATE);
+
+	blend_init(&layers[ANIM_STANDBY], 0, 0);
+	blend_init(&layers[ANIM_RESET], 0.8, 0);
+	blend_init(&layers[ANIM_FLY], 2, 0);
+	blend_init(&layers[ANIM_DANCE], 5, 0);
+	blend_init(&layers[ANIM_WALK], 2, 0);
+	blend_init(&layers[ANIM_CLIP], 5, 0);
+	joint_movable(&mask);
+	for ( i = ANIM_RESET; i <= ANIM_WALK; i++ )
+		blend_weigh(&layers[i], &mask);
+	/* don't override global rotations */
+	layers[ANIM_FLY].weight.rot[AXIS_X][SL_BODY] = 0;
+	layers[ANIM_FLY].weight.rot[AXIS_Y][SL_BODY] = 0;
+	layers[ANIM_DANCE].weight.rot[AXIS_X][SL_BODY] = 0;
+	layers[ANIM_DANCE].weight.rot[AXIS_Y][SL_BODY] = 0;
+	layers[ANIM_WALK].weight.rot[AXIS_Y][SL_BODY] = 0;
+
+	blend_init(&layers[ANIMATIONS + OVERLAY_WAVE], 5, 1);
+	blend_init(&reach, 5, 0);
+	layers[ANIMATIONS + OVERLAY_WAVE].weight.rot[AXIS_X][SL_R_UPPERARM] = 1;
+	layers[ANIMATIONS + OVERLAY_WAVE].weight.rot[AXIS_Y][SL_R_FOREARM] = 1;
+
+	/* over a period of each; the dance's headlights go round once
+	 * every three */
+	bake_loops(ANIM_FLY, ROBOT_PERIOD);
+	bake_loops(ANIM_DANCE, 3 * ROBOT_PERIOD);
+	bake_loops(ANIM_WALK, ROBOT_PERIOD);
+	bake_loops(ANIMATIONS + OVERLAY_WAVE, ROBOT_PERIOD / 10);
+	last = joint_angles;
+}
+
+/* adds the joints as they are to the recording */
+static void record_key(void) {
+	joint_pose *grown;
+	int room;
+
+	if ( recorded_keys >= ANIM_RECORD_MAX )
+		return;
+	if ( recorded_keys == recorded_room ) {
+		room = recorded_room ? recorded_room * 2 : 
+			(int)(10 * ROBOT_FRAMES_PER_S);
+		grown = realloc(recorded, sizeof(joint_pose) * room);
+		if ( !grown ) {
+			printf("%s %d:  can't allocate the recording\n", 
+				__FILE__, __LINE__);
+			recording = 0;
+			return;
+		}
+		recorded = grown;
+		recorded_room = room;
 	}
+	recorded[recorded_keys++] = joint_angles;
+}
+
+/* Progresses the animation state 1 frame */
+void animate_think(void) {
+	int i, changed;
+
+	last = joint_angles;
+	anim_seq++;
+	blend_think(&reach);
+	if ( reach.fade <= 0 && reach.fade_to <= 0 )
+		reach_limb = -1;
+	for ( i = 0; i < ANIMATIONS + OVERLAYS; i++ ) {
+		blend_think(&layers[i]);
+		if ( layers[i].fade <= 0 )
+			continue;
+		loops(i, &layers[i].pose);
+		switch(i) {
+			case ANIM_FLY:
+				fly(&layers[i].pose);
+				break;
+			case ANIM_CLIP:
+				play_clip(&layers[i].pose);
+				break;
+		}
+	}
+	changed = move_joints();
+
+	/* the reset is over once it has faded in and the joints are back 
+	 * where they started */
+	if ( animation == ANIM_RESET && !changed && 
+			layers[ANIM_RESET].fade >= 1 ) {
+		animation = ANIM_STANDBY;
+		blend_fade(&layers[ANIM_RESET], 0, 0);
+	}
+	if ( recording )
+		record_key();
+}
+
+/* fills in out with the joints alpha of the way from where they were
+ * before the latest tick to where they are now, for drawing between 
+ * ticks.  Each angle goes the short way round, so that a headlight 
+ * wrapping from 359 to 0 turns on rather than spinning back. */
+void animate_lerp(float alpha, joint_pose *out) {
+	const float *from = last.rot[0];
+	const float *to = joint_angles.rot[0];
+	float *o = out->rot[0];
+	int c;
+
+	for ( c = 0; c < POSE_CHANNELS; c++ )
+		o[c] = from[c] + remainderf(to[c] - from[c], 360) * alpha;
+	anim_time = anim_seq - 1 + alpha;
+}
+
+/* fades the layer of anim in, and those of the other animations out */
+static void crossfade(enum animation anim) {
+	int i;
+
+	for ( i = 0; i < ANIMATIONS; i++ )
+		blend_fade(&layers[i], i == (int)anim, ANIM_FADE);
 }
 
 /* Changes the animation sequence */
 void animate(enum animation anim) {
+	int i;
+
 	/* stupidity check */
 	switch(anim) {
 		case ANIM_STANDBY:
 			animation = anim;
+			crossfade(anim);
 			break;
 		case ANIM_RESET:
 			animation = anim;
-			start_reset();
+			start_reset(&layers[anim].pose);
+			crossfade(anim);
+			/* a reset puts everything back */
+			for ( i = 0; i < OVERLAYS; i++ )
+				animate_overlay(i, 0);
+			animate_reach(NULL);
 			break;
 		case ANIM_FLY:
 			animation = anim;
-			start_fly();
+			start_fly(&layers[anim].pose);
+			crossfade(anim);
 			break;
 		case ANIM_DANCE:
 			animation = anim;
-			start_dance();
+			start_dance(&layers[anim].pose);
+			crossfade(anim);
 			break;
 		case ANIM_WALK:
 			animation = anim;
-			start_walk();
+			start_walk(&layers[anim].pose);
+			crossfade(anim);
+			break;
+		case ANIM_CLIP:
+			if ( !clip_get(playing) ) {
+				printf("%s %d:  No clip to play\n", __FILE__, 
+					__LINE__);
+				break;
+			}
+			animation = anim;
+			start_clip(&layers[anim].pose);
+			crossfade(anim);
 			break;
 		default:
 			printf("%s %d:  Invalid animation\n", __FILE__, __LINE__);
@@ -272,3 +546,185 @@ void animate(enum animation anim) {
 enum animation get_animation(void) {
 	return animation;
 }
+
+/* Plays clip, from the library */
+void animate_clip(int clip) {
+	if ( !clip_get(clip) ) {
+		printf("%s %d:  Invalid clip\n", __FILE__, __LINE__);
+		return;
+	}
+	playing = clip;
+	animate(ANIM_CLIP);
+}
+
+/* Retrieves the library clip being played, or the last one */
+int get_clip(void) {
+	return playing;
+}
+
+/* Fades an overlay in on top of the animation, or back out */
+void animate_overlay(enum overlay overlay, int on) {
+	if ( overlay >= OVERLAYS ) {
+		printf("%s %d:  Invalid overlay\n", __FILE__, __LINE__);
+		return;
+	}
+	blend_fade(&layers[ANIMATIONS + overlay], on ? 1 : 0, ANIM_FADE);
+}
+
+/* Retrieves whether an overlay is on (or fading in) */
+int get_overlay(enum overlay overlay) {
+	if ( overlay >= OVERLAYS )
+		return 0;
+	return layers[ANIMATIONS + overlay].fade_to > 0;
+}
+
+/* Has the arm nearer target reach for it, target being relative to the
+ * robot like the joint matrices; NULL lets go again.  The reach fades 
+ * in and out like an overlay. */
+void animate_reach(const float *target) {
+	const float *l, *r;
+	float dl = 0, dr = 0;
+	int i;
+
+	if ( !target ) {
+		blend_fade(&reach, 0, ANIM_FADE);
+		return;
+	}
+	/* from the shoulders as the last tick left them */
+	l = joint_base(SL_L_UPPERARM) + 12;
+	r = joint_base(SL_R_UPPERARM) + 12;
+	for ( i = 0; i < 3; i++ ) {
+		dl += (target[i] - l[i]) * (target[i] - l[i]);
+		dr += (target[i] - r[i]) * (target[i] - r[i]);
+		reach_target[i] = target[i];
+	}
+	/* the other arm lets go straight away */
+	if ( reach_limb != (dl < dr ? IK_L_ARM : IK_R_ARM) )
+		reach.fade = 0;
+	reach_limb = dl < dr ? IK_L_ARM : IK_R_ARM;
+	blend_fade(&reach, 1, ANIM_FADE);
+}
+
+/* Retrieves whether an arm is reaching for something (or starting to) */
+int get_reach(void) {
+	return reach_limb >= 0 && reach.fade_to > 0;
+}
+
+/* Starts recording the joints, a key a tick, for animate_record_save to
+ * make a clip of */
+void animate_record(void) {
+	recorded_keys = 0;
+	recording = 1;
+}
+
+/* Stops recording, and saves what was recorded as a clip called name at
+ * path, adding it to the library.  The clip moves every joint but the 
+ * body's global rotation, which it leaves to the user as the 
+ * animations do.  Returns where it is in the library, or -1 if it 
+ * can't be made. */
+int animate_record_save(const char *name, const char *path) {
+	joint_pose weight;
+	joint_mask mask;
+	float *w = weight.rot[0];
+	const uint32_t *on = mask.on[0];
+	clip_t clip;
+	int c, ok;
+
+	recording = 0;
+	if ( !recorded_keys ) {
+		printf("%s %d:  nothing was recorded\n", __FILE__, __LINE__);
+		return -1;
+	}
+	joint_movable(&mask);
+	for ( c = 0; c < POSE_CHANNELS; c++ )
+		w[c] = on[c] ? 1 : 0;
+	weight.rot[AXIS_X][SL_BODY] = 0;
+	weight.rot[AXIS_Y][SL_BODY] = 0;
+	if ( !clip_build(&clip, name, recorded, recorded_keys, 
+			ROBOT_FRAMES_PER_S, 0, &weight) )
+		return -1;
+	ok = clip_save(&clip, path);
+	clip_free(&clip);
+	return ok ? clip_add(path) : -1;
+}
+
+/* Retrieves whether the joints are being recorded */
+int get_recording(void) {
+	return recording;
+}
+
+/* the animation's part of a snapshot */
+typedef struct {
+	int32_t animation;
+	int32_t seq;
+	rng_t rng;
+	int32_t playing;
+	int32_t clip_start;
+	blend_layer layers[ANIMATIONS + OVERLAYS];
+	int32_t reach_limb;
+	float reach_target[3];
+	blend_layer reach;
+} animate_snapshot;
+
+/* writes the animation, and where it is up to, to a snapshot */
+void animate_save(snapshot_writer *w) {
+	animate_snapshot a;
+
+	memset(&a, 0, sizeof(a));
+	a.animation = animation;
+	a.seq = anim_seq;
+	a.rng = anim_rng;
+	a.playing = playing;
+	a.clip_start = clip_start;
+	memcpy(a.layers, layers, sizeof(a.layers));
+	a.reach_limb = reach_limb;
+	memcpy(a.reach_target, reach_target, sizeof(a.reach_target));
+	a.reach = reach;
+	snapshot_begin(w, SNAP_ANIMATE);
+	snapshot_write(w, &a, sizeof(a));
+	snapshot_end(w);
+}
+
+/* finds the animation in a snapshot.  Returns NULL if it has none, or
+ * it is playing an animation or a clip that isn't there. */
+static const animate_snapshot *animate_find(const snapshot_t *s) {
+	snapshot_reader r;
+	const animate_snapshot *a;
+
+	if ( !snapshot_find(s, SNAP_ANIMATE, &r) )
+		return NULL;
+	a = snapshot_read(&r, sizeof(*a));
+	if ( !a || a->animation < ANIM_STANDBY || a->animation >= ANIMATIONS ||
+			a->playing < -1 || a->playing >= clip_count() ||
+			a->reach_limb < -1 || a->reach_limb > IK_R_ARM )
+		return NULL;
+	return a;
+}
+
+/* checks the snapshot's animation can be restored, without restoring 
+ * it */
+int animate_check(const snapshot_t *s) {
+	return animate_find(s) != NULL;
+}
+
+/* restores the animation from a snapshot.  It carries on from where it
+ * was, without being started again.  Returns 0 if the snapshot has no 
+ * animation. */
+int animate_restore(const snapshot_t *s) {
+	const animate_snapshot *a;
+
+	if ( !(a = animate_find(s)) )
+		return 0;
+	animation = a->animation;
+	anim_seq = a->seq;
+	anim_rng = a->rng;
+	playing = a->playing;
+	clip_start = a->clip_start;
+	memcpy(layers, a->layers, sizeof(layers));
+	reach_limb = a->reach_limb;
+	memcpy(reach_target, a->reach_target, sizeof(reach_target));
+	reach = a->reach;
+	/* the joints are restored first; start drawing from there */
+	last = joint_angles;
+	return 1;
+}
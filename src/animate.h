@@ -25,6 +25,9 @@
  * nanobot.c, and applies joint transformations using functions from 
  * joint.c
  *************************************************************************/
+#include "snapshot.h"
+#include "joint.h"
+
 #define ROBOT_MS_PER_FRAME 25
 #define ROBOT_FRAMES_PER_MS (1.0/ROBOT_MS_PER_FRAME)
 #define ROBOT_FRAMES_PER_S (1000.0 * ROBOT_FRAMES_PER_MS)
@@ -36,9 +39,30 @@ enum animation {
 	ANIM_RESET,
 	ANIM_FLY,
 	ANIM_DANCE,
-	ANIM_WALK
+	ANIM_WALK,
+	ANIM_CLIP
+};
+
+/* motions laid over whichever animation is running */
+enum overlay {
+	OVERLAY_WAVE
 };
+#define OVERLAYS 1
 
+void init_animation(void);
 void animate_think(void);
+void animate_lerp(float alpha, joint_pose *out);
 void animate(enum animation anim);
 enum animation get_animation(void);
+void animate_overlay(enum overlay overlay, int on);
+int get_overlay(enum overlay overlay);
+void animate_reach(const float *target);
+int get_reach(void);
+void animate_record(void);
+int animate_record_save(const char *name, const char *path);
+int get_recording(void);
+void animate_clip(int clip);
+int get_clip(void);
+void animate_save(snapshot_writer *w);
+int animate_check(const snapshot_t *s);
+int animate_restore(const snapshot_t *s);
@@ -0,0 +1,155 @@
+/************************************************************************** 
+ * Nanobot:  A simple, interactive robot rendered using OpenGL
+ * Copyright (C) 2007, Corey Edmunds (corey.edmunds@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *************************************************************************/
+
+
+/**************************************************************************
+ * blend.c/h
+ *
+ * Mixes poses.  Each source of motion (an animation, say) fills in a 
+ * layer: the angles it wants, how much each of them counts, and how far 
+ * the layer is faded in.  blend_mix puts the layers together into the
+ * one pose the joints are stepped towards, so changing from one source
+ * to another is a crossfade, and an additive layer (a wave) can be laid
+ * over any other without a routine for each pair.
+ *
+ * Everything works on whole joint_pose arrays, a layer at a time.
+ *************************************************************************/
+#include <string.h>
+#include "blend.h"
+
+/* the angles in a pose, counting the padding slots */
+#define POSE_ANGLES (JOINT_AXES * JOINT_SLOTS)
+
+/* sets up an empty layer, faded out, that the joints follow at speed */
+void blend_init(blend_layer *layer, float speed, int additive) {
+	memset(layer, 0, sizeof(*layer));
+	layer->speed = speed;
+	layer->additive = additive;
+}
+
+/* makes layer count fully on the angles mask has on, and not at all on
+ * the rest */
+void blend_weigh(blend_layer *layer, const joint_mask *mask) {
+	float *weight = layer->weight.rot[0];
+	const uint32_t *on = mask->on[0];
+	int i;
+
+	for ( i = 0; i < POSE_ANGLES; i++ )
+		weight[i] = on[i] ? 1 : 0;
+}
+
+/* starts fading layer to to, over ticks ticks (0 for straight away) */
+void blend_fade(blend_layer *layer, float to, int ticks) {
+	layer->fade_to = to;
+	if ( ticks > 0 ) {
+		layer->fade_step = 1.0 / ticks;
+	} else {
+		layer->fade = to;
+		layer->fade_step = 0;
+	}
+}
+
+/* moves layer's fade on a tick */
+void blend_think(blend_layer *layer) {
+	if ( layer->fade < layer->fade_to ) {
+		layer->fade += layer->fade_step;
+		if ( layer->fade > layer->fade_to )
+			layer->fade = layer->fade_to;
+	} else if ( layer->fade > layer->fade_to ) {
+		layer->fade -= layer->fade_step;
+		if ( layer->fade < layer->fade_to )
+			layer->fade = layer->fade_to;
+	}
+}
+
+/* Mixes count layers into out.  Where the layers that aren't additive 
+ * count for 1 or more between them, out is their weighted average;
+ * where they count for less, from (the angles the joints are at) makes 
+ * up the rest, so a layer fading in or out eases from or to where the
+ * joints are.  The additive layers are then added on top -- not of 
+ * that, which would add to the joints' angles every tick and walk them
+ * off to their limits, but of the other layers' average on its own, or 
+ * the angles the joints start at where no other layer counts.  As an 
+ * additive layer fades in, out goes over from the first mix to that.  
+ * speed is set to how fast each angle follows: the layers' speeds, 
+ * weighted the same way as their angles, so each layer's joints move 
+ * at its own pace and a crossfade eases from one pace to the other.
+ * mask is set to the angles any layer counts on; the rest are left 
+ * alone. */
+void blend_mix(joint_pose *out, joint_pose *speed, joint_mask *mask, 
+		const joint_pose *from, const blend_layer *layers, int count) {
+	float total[POSE_ANGLES], added[POSE_ANGLES], offset[POSE_ANGLES];
+	joint_pose rest;
+	float *o = out->rot[0];
+	float *sp = speed->rot[0];
+	const float *f = from->rot[0];
+	const float *r = rest.rot[0];
+	uint32_t *on = mask->on[0];
+	float base, k;
+	int l, i, additive = 0;
+
+	memset(out, 0, sizeof(*out));
+	memset(speed, 0, sizeof(*speed));
+	memset(total, 0, sizeof(total));
+	memset(added, 0, sizeof(added));
+	memset(offset, 0, sizeof(offset));
+	for ( l = 0; l < count; l++ ) {
+		const float *p = layers[l].pose.rot[0];
+		const float *w = layers[l].weight.rot[0];
+		float fade = layers[l].fade;
+
+		float v = layers[l].speed;
+
+		if ( fade <= 0 )
+			continue;
+		if ( layers[l].additive ) {
+			additive = 1;
+			for ( i = 0; i < POSE_ANGLES; i++ ) {
+				offset[i] += p[i] * w[i] * fade;
+				added[i] += w[i] * fade;
+				sp[i] += v * w[i] * fade;
+			}
+		} else {
+			for ( i = 0; i < POSE_ANGLES; i++ ) {
+				o[i] += p[i] * w[i] * fade;
+				total[i] += w[i] * fade;
+				sp[i] += v * w[i] * fade;
+			}
+		}
+	}
+
+	if ( additive )
+		joint_base_pose(&rest);
+	for ( i = 0; i < POSE_ANGLES; i++ ) {
+		base = total[i] > 0 ? o[i] / total[i] : 0;
+		if ( total[i] < 1 )
+			o[i] += f[i] * (1 - total[i]);
+		else
+			o[i] = base;
+		if ( added[i] > 0 ) {
+			if ( total[i] <= 0 )
+				base = r[i];
+			k = added[i] < 1 ? added[i] : 1;
+			o[i] += (base - o[i]) * k + offset[i];
+		}
+		if ( total[i] + added[i] > 0 )
+			sp[i] /= total[i] + added[i];
+		on[i] = total[i] > 0 || added[i] > 0 ? ~0u : 0;
+	}
+}
@@ -0,0 +1,54 @@
+/************************************************************************** 
+ * Nanobot:  A simple, interactive robot rendered using OpenGL
+ * Copyright (C) 2007, Corey Edmunds (corey.edmunds@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *************************************************************************/
+
+
+/**************************************************************************
+ * blend.c/h
+ *
+ * Mixes poses.  Each source of motion (an animation, say) fills in a 
+ * layer: the angles it wants, how much each of them counts, and how far 
+ * the layer is faded in.  blend_mix puts the layers together into the
+ * one pose the joints are stepped towards, so changing from one source
+ * to another is a crossfade, and an additive layer (a wave) can be laid
+ * over any other without a routine for each pair.
+ *
+ * Everything works on whole joint_pose arrays, a layer at a time.
+ *************************************************************************/
+#ifndef __BLEND_H
+#define __BLEND_H
+#include "joint.h"
+
+/* one source of angles, and how much of it to use */
+typedef struct {
+	joint_pose pose;	/* the angles it wants, or adds if additive */
+	joint_pose weight;	/* how much each of them counts, 0 to 1 */
+	float speed;		/* how fast the joints follow it, a tick */
+	float fade;		/* how far it is faded in, 0 to 1 */
+	float fade_to;		/* where the fade is going */
+	float fade_step;	/* and how far it goes a tick */
+	int32_t additive;
+} blend_layer;
+
+void blend_init(blend_layer *layer, float speed, int additive);
+void blend_weigh(blend_layer *layer, const joint_mask *mask);
+void blend_fade(blend_layer *layer, float to, int ticks);
+void blend_think(blend_layer *layer);
+void blend_mix(joint_pose *out, joint_pose *speed, joint_mask *mask, 
+	const joint_pose *from, const blend_layer *layers, int count);
+#endif
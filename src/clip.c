@@ -0,0 +1,390 @@
+/************************************************************************** 
+ * Nanobot:  A simple, interactive robot rendered using OpenGL
+ * Copyright (C) 2007, Corey Edmunds (corey.edmunds@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *************************************************************************/
+
+
+/**************************************************************************
+ * clip.c/h
+ *
+ * Keyframed motion clips.  A clip is a run of poses, keys, spaced evenly
+ * in time, with every angle of every joint (each a channel) kept as a 
+ * 16 bit step between its channel's lowest and highest value.  On disk a 
+ * clip is a header and then the keys, in the writing machine's byte 
+ * order, so it is mapped and used where it lies with no parsing.  
+ * clip_sample works out every channel at a time t in one pass over two 
+ * keys.
+ *
+ * The clips found at startup are kept in a library, which animate.c 
+ * plays them from.
+ *************************************************************************/
+#include "clip.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __SSE2__
+	#include <emmintrin.h>
+#endif
+
+#define CLIP_MAGIC "NANOCLIP"
+/* reads back as something else on a machine of the other byte order */
+#define CLIP_BYTE_ORDER 0x01020304
+/* what clip files are called */
+#define CLIP_SUFFIX ".clip"
+
+/* the clips loaded at startup */
+static clip_t library[CLIP_MAX];
+static int clips = 0;
+
+/* the bytes a clip of keys keys takes */
+static size_t clip_size(uint32_t keys) {
+	return sizeof(clip_header) + 
+		(size_t)keys * CLIP_CHANNELS * sizeof(int16_t);
+}
+
+/* Builds a clip in memory from count poses, rate a second, quantizing 
+ * each channel between its lowest and highest value.  weight is how much 
+ * the clip counts on each channel.  Returns 0 if it can't. */
+int clip_build(clip_t *clip, const char *name, const joint_pose *keys, 
+		int count, float rate, int looped, const joint_pose *weight) {
+	clip_header *h;
+	int16_t *q;
+	const float *key;
+	float *bias, *scale;
+	float lo, hi, v;
+	int c, k;
+
+	memset(clip, 0, sizeof(*clip));
+	if ( count < 1 || rate <= 0 )
+		return 0;
+	clip->size = clip_size(count);
+	clip->data = calloc(1, clip->size);
+	if ( !clip->data ) {
+		printf("%s %d:  can't allocate clip %s\n", __FILE__, __LINE__, 
+			name);
+		return 0;
+	}
+	h = clip->data;
+	q = (int16_t*)(h + 1);
+	memcpy(h->magic, CLIP_MAGIC, sizeof(h->magic));
+	strncpy(h->name, name, CLIP_NAME - 1);
+	h->version = CLIP_VERSION;
+	h->byte_order = CLIP_BYTE_ORDER;
+	h->keys = count;
+	h->looped = looped;
+	h->rate = rate;
+	h->weight = *weight;
+
+	bias = h->bias.rot[0];
+	scale = h->scale.rot[0];
+	for ( c = 0; c < CLIP_CHANNELS; c++ ) {
+		key = keys[0].rot[0];
+		lo = hi = key[c];
+		for ( k = 1; k < count; k++ ) {
+			key = keys[k].rot[0];
+			v = key[c];
+			if ( v < lo )
+				lo = v;
+			if ( v > hi )
+				hi = v;
+		}
+		bias[c] = (lo + hi) / 2;
+		scale[c] = (hi - lo) / (2 * INT16_MAX);
+		if ( scale[c] <= 0 )
+			continue;
+		for ( k = 0; k < count; k++ ) {
+			key = keys[k].rot[0];
+			v = rintf((key[c] - bias[c]) / scale[c]);
+			if ( v > INT16_MAX )
+				v = INT16_MAX;
+			if ( v < -INT16_MAX )
+				v = -INT16_MAX;
+			q[k * CLIP_CHANNELS + c] = v;
+		}
+	}
+
+	clip->head = h;
+	clip->keys = q;
+	return 1;
+}
+
+/* writes clip to path, through a temporary file so a failed write leaves
+ * any clip already there alone.  Returns 0 if it can't. */
+int clip_save(const clip_t *clip, const char *path) {
+	FILE *f;
+	char *temp;
+	int ok;
+
+	temp = malloc(strlen(path) + 5);
+	if ( !temp )
+		return 0;
+	sprintf(temp, "%s.new", path);
+	f = fopen(temp, "wb");
+	if ( !f ) {
+		printf("%s %d:  can't write %s: %s\n", __FILE__, __LINE__, 
+			temp, strerror(errno));
+		free(temp);
+		return 0;
+	}
+	ok = fwrite(clip->data, clip->size, 1, f) == 1;
+	if ( fclose(f) )
+		ok = 0;
+	if ( ok && rename(temp, path) )
+		ok = 0;
+	if ( !ok ) {
+		printf("%s %d:  can't write %s: %s\n", __FILE__, __LINE__, 
+			path, strerror(errno));
+		remove(temp);
+	}
+	free(temp);
+	return ok;
+}
+
+/* whether every channel of h's bias and scale is a number, and every 
+ * weight is from 0 to 1 -- a clip's are used as they are, all the way 
+ * into the joints */
+static int clip_channels_ok(const clip_header *h) {
+	const float *bias = h->bias.rot[0];
+	const float *scale = h->scale.rot[0];
+	const float *weight = h->weight.rot[0];
+	int c;
+
+	for ( c = 0; c < CLIP_CHANNELS; c++ )
+		if ( !isfinite(bias[c]) || !isfinite(scale[c]) || 
+				!(weight[c] >= 0 && weight[c] <= 1) )
+			return 0;
+	return 1;
+}
+
+/* Maps the clip at path.  It stays mapped, and is used where it lies, 
+ * until clip_free.  Returns 0 if it can't be used. */
+int clip_load(clip_t *clip, const char *path) {
+	const clip_header *h;
+	struct stat st;
+	void *map;
+	int fd;
+
+	memset(clip, 0, sizeof(*clip));
+	fd = open(path, O_RDONLY);
+	if ( fd < 0 || fstat(fd, &st) ) {
+		printf("%s %d:  can't read %s: %s\n", __FILE__, __LINE__, 
+			path, strerror(errno));
+		if ( fd >= 0 )
+			close(fd);
+		return 0;
+	}
+	if ( (size_t)st.st_size < sizeof(clip_header) ) {
+		printf("%s %d:  %s is not a clip\n", __FILE__, __LINE__, path);
+		close(fd);
+		return 0;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if ( map == MAP_FAILED ) {
+		printf("%s %d:  can't map %s: %s\n", __FILE__, __LINE__, 
+			path, strerror(errno));
+		return 0;
+	}
+
+	h = map;
+	if ( memcmp(h->magic, CLIP_MAGIC, sizeof(h->magic)) || 
+			h->byte_order != CLIP_BYTE_ORDER )
+		printf("%s %d:  %s is not a clip from this machine\n", 
+			__FILE__, __LINE__, path);
+	else if ( h->version != CLIP_VERSION )
+		printf("%s %d:  %s is version %u, not %d\n", __FILE__, __LINE__, 
+			path, h->version, CLIP_VERSION);
+	else if ( h->keys < 1 || !(h->rate > 0) || !isfinite(h->rate) ||
+			clip_size(h->keys) != (size_t)st.st_size ||
+			!memchr(h->name, 0, CLIP_NAME) || !clip_channels_ok(h) )
+		printf("%s %d:  %s is damaged\n", __FILE__, __LINE__, path);
+	else {
+		clip->head = h;
+		clip->keys = (const int16_t*)(h + 1);
+		clip->data = map;
+		clip->size = st.st_size;
+		clip->mapped = 1;
+		return 1;
+	}
+	munmap(map, st.st_size);
+	return 0;
+}
+
+/* lets go of a clip from clip_build or clip_load */
+void clip_free(clip_t *clip) {
+	if ( clip->mapped )
+		munmap(clip->data, clip->size);
+	else
+		free(clip->data);
+	memset(clip, 0, sizeof(*clip));
+}
+
+/* how long clip runs for, in seconds, before it loops or stops */
+float clip_length(const clip_t *clip) {
+	const clip_header *h = clip->head;
+
+	return (h->looped ? h->keys : h->keys - 1) / h->rate;
+}
+
+/* Works out every channel of clip at t seconds into out, between the two
+ * keys either side.  A looped clip wraps round; one that isn't holds its
+ * first or last key outside its length. */
+void clip_sample(const clip_t *clip, float t, joint_pose *out) {
+	const clip_header *h = clip->head;
+	const float *bias = h->bias.rot[0];
+	const float *scale = h->scale.rot[0];
+	const int16_t *a, *b;
+	float *o = out->rot[0];
+	float k, f;
+	int k0, k1, c = 0;
+
+	k = t * h->rate;
+	if ( h->looped ) {
+		k = fmodf(k, h->keys);
+		if ( k < 0 )
+			k += h->keys;
+		/* which can round up to keys itself */
+		if ( k >= h->keys )
+			k = 0;
+		k0 = k;
+		k1 = (uint32_t)k0 + 1 < h->keys ? k0 + 1 : 0;
+	} else {
+		if ( k < 0 )
+			k = 0;
+		if ( k > h->keys - 1 )
+			k = h->keys - 1;
+		k0 = k;
+		k1 = (uint32_t)k0 + 1 < h->keys ? k0 + 1 : k0;
+	}
+	f = k - k0;
+	a = clip->keys + (size_t)k0 * CLIP_CHANNELS;
+	b = clip->keys + (size_t)k1 * CLIP_CHANNELS;
+
+#ifdef __SSE2__
+	{
+		const __m128 vf = _mm_set1_ps(f);
+		__m128i qa, qb;
+		__m128 fa, fb;
+		int half;
+
+		for ( ; c + 8 <= CLIP_CHANNELS; c += 8 ) {
+			qa = _mm_loadu_si128((const __m128i*)(a + c));
+			qb = _mm_loadu_si128((const __m128i*)(b + c));
+			/* the eight steps, four at a time, widened to floats */
+			for ( half = 0; half < 2; half++ ) {
+				if ( half ) {
+					fa = _mm_cvtepi32_ps(_mm_srai_epi32(
+						_mm_unpackhi_epi16(qa, qa), 16));
+					fb = _mm_cvtepi32_ps(_mm_srai_epi32(
+						_mm_unpackhi_epi16(qb, qb), 16));
+				} else {
+					fa = _mm_cvtepi32_ps(_mm_srai_epi32(
+						_mm_unpacklo_epi16(qa, qa), 16));
+					fb = _mm_cvtepi32_ps(_mm_srai_epi32(
+						_mm_unpacklo_epi16(qb, qb), 16));
+				}
+				fa = _mm_add_ps(fa, 
+					_mm_mul_ps(_mm_sub_ps(fb, fa), vf));
+				_mm_storeu_ps(o + c + half * 4, _mm_add_ps(
+					_mm_loadu_ps(bias + c + half * 4), 
+					_mm_mul_ps(fa, 
+					_mm_loadu_ps(scale + c + half * 4))));
+			}
+		}
+	}
+#endif
+	for ( ; c < CLIP_CHANNELS; c++ )
+		o[c] = bias[c] + scale[c] * (a[c] + (b[c] - a[c]) * f);
+}
+
+/* Maps every clip (a file ending in .clip) in dir into the library.
+ * Returns how many were loaded. */
+int clip_load_dir(const char *dir) {
+	struct dirent *e;
+	char *path;
+	DIR *d;
+	size_t n;
+	int loaded = 0;
+
+	d = opendir(dir);
+	if ( !d ) {
+		printf("%s %d:  can't read %s: %s\n", __FILE__, __LINE__, 
+			dir, strerror(errno));
+		return 0;
+	}
+	while ( (e = readdir(d)) ) {
+		n = strlen(e->d_name);
+		if ( n <= strlen(CLIP_SUFFIX) || strcmp(e->d_name + n - 
+				strlen(CLIP_SUFFIX), CLIP_SUFFIX) )
+			continue;
+		if ( clips >= CLIP_MAX ) {
+			printf("%s %d:  more than %d clips, skipping the rest\n",
+				__FILE__, __LINE__, CLIP_MAX);
+			break;
+		}
+		path = malloc(strlen(dir) + n + 2);
+		if ( !path )
+			break;
+		sprintf(path, "%s/%s", dir, e->d_name);
+		if ( clip_add(path) >= 0 )
+			loaded++;
+		free(path);
+	}
+	closedir(d);
+	return loaded;
+}
+
+/* Maps the clip at path into the library.  Returns where it is in the 
+ * library, or -1 if it can't be used or the library is full. */
+int clip_add(const char *path) {
+	if ( clips >= CLIP_MAX ) {
+		printf("%s %d:  no room for %s\n", __FILE__, __LINE__, path);
+		return -1;
+	}
+	if ( !clip_load(&library[clips], path) )
+		return -1;
+	return clips++;
+}
+
+/* how many clips the library holds */
+int clip_count(void) {
+	return clips;
+}
+
+/* a clip in the library, or NULL */
+const clip_t *clip_get(int clip) {
+	if ( clip < 0 || clip >= clips )
+		return NULL;
+	return &library[clip];
+}
+
+/* the library's clip called name, or -1 */
+int clip_find(const char *name) {
+	int i;
+
+	for ( i = 0; i < clips; i++ )
+		if ( !strncmp(library[i].head->name, name, CLIP_NAME) )
+			return i;
+	return -1;
+}
@@ -0,0 +1,89 @@
+/************************************************************************** 
+ * Nanobot:  A simple, interactive robot rendered using OpenGL
+ * Copyright (C) 2007, Corey Edmunds (corey.edmunds@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *************************************************************************/
+
+
+/**************************************************************************
+ * clip.c/h
+ *
+ * Keyframed motion clips.  A clip is a run of poses, keys, spaced evenly
+ * in time, with every angle of every joint (each a channel) kept as a 
+ * 16 bit step between its channel's lowest and highest value.  On disk a 
+ * clip is a header and then the keys, in the writing machine's byte 
+ * order, so it is mapped and used where it lies with no parsing.  
+ * clip_sample works out every channel at a time t in one pass over two 
+ * keys.
+ *
+ * The clips found at startup are kept in a library, which animate.c 
+ * plays them from.
+ *************************************************************************/
+#ifndef __CLIP_H
+#define __CLIP_H
+#include <stddef.h>
+#include <stdint.h>
+#include "joint.h"
+
+/* bump whenever the header changes, so old clips are refused */
+#define CLIP_VERSION 1
+
+/* the channels in a key: a pose's angles, counting the padding slots */
+#define CLIP_CHANNELS (JOINT_AXES * JOINT_SLOTS)
+
+/* how long a clip's name can be, and how many clips the library holds */
+#define CLIP_NAME 32
+#define CLIP_MAX 64
+
+/* a clip file's header, followed by keys keys of CLIP_CHANNELS int16_t.
+ * A channel's angle is bias + scale * its step. */
+typedef struct {
+	char magic[8];
+	char name[CLIP_NAME];
+	uint32_t version;
+	uint32_t byte_order;
+	uint32_t keys;
+	uint32_t looped;	/* whether the last key runs back to the first */
+	float rate;		/* keys a second */
+	uint32_t reserved;
+	joint_pose bias;
+	joint_pose scale;
+	joint_pose weight;	/* how much the clip counts on each channel */
+} clip_header;
+
+/* a clip, mapped from a file or built in memory */
+typedef struct {
+	const clip_header *head;
+	const int16_t *keys;
+	void *data;
+	size_t size;
+	int mapped;
+} clip_t;
+
+int clip_build(clip_t *clip, const char *name, const joint_pose *keys, 
+	int count, float rate, int looped, const joint_pose *weight);
+int clip_save(const clip_t *clip, const char *path);
+int clip_load(clip_t *clip, const char *path);
+void clip_free(clip_t *clip);
+float clip_length(const clip_t *clip);
+void clip_sample(const clip_t *clip, float t, joint_pose *out);
+
+int clip_load_dir(const char *dir);
+int clip_add(const char *path);
+int clip_count(void);
+const clip_t *clip_get(int clip);
+int clip_find(const char *name);
+#endif
@@ -0,0 +1,322 @@
+/************************************************************************** 
+ * Nanobot:  A simple, interactive robot rendered using OpenGL
+ * Copyright (C) 2007, Corey Edmunds (corey.edmunds@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *************************************************************************/
+
+
+/**************************************************************************
+ * collide.c/h
+ *
+ * Keeps the smoke out of the robot.  The parts are roughly fitted with
+ * capsules (a line segment and a radius; a sphere is a capsule of no 
+ * length), placed each tick from the kinematics, and particles found 
+ * inside one are pushed out to its surface and lose the part of their
+ * velocity heading in.
+ *
+ * Nearly all the smoke is nowhere near nearly all the capsules, so the
+ * test is culled three times before any real work is done: a run of 
+ * particles only looks at the capsules whose boxes overlap the run's 
+ * box, a vector of particles only looks at those if one of them is 
+ * inside the box around them all, and only does the distance sums for
+ * a capsule if one of them is inside its box.  The run's box is cheap 
+ * and does well on smoke spawned together, but the pool is compacted by
+ * swapping the dead out and the emitters' smoke is interleaved, so a 
+ * run can be spread right along the plume; the vector's test still 
+ * culls then.  The boxes are open: a particle on one's surface is 
+ * outside it, in the vector kernels and out.
+ *
+ * The thrusters have no capsule: they are where the smoke comes from.
+ * The fingers, toes, headlights and solar panels are too small or too 
+ * flat to bother with.
+ *************************************************************************/
+#include <math.h>
+#include "collide.h"
+#include "kinematics.h"
+#include "matrix.h"
+#include "cpu.h"
+#ifdef SIMD_X86
+	#include <immintrin.h>
+#endif
+
+/* a part's capsule, in its joint's frame */
+typedef struct {
+	enum joint_label joint;
+	float a[3];
+	float b[3];
+	float radius;
+} capsule_shape;
+
+static const capsule_shape shapes[] = {
+	{ SL_BODY, { 0, 0, 0 }, { 0, 0, 0 }, 1.0 },
+	/* the hips */
+	{ SL_BODY, { 0.643, -0.766, 0 }, { 0.643, -0.766, 0 }, 0.20 },
+	{ SL_BODY, { -0.643, -0.766, 0 }, { -0.643, -0.766, 0 }, 0.20 },
+	{ SL_CAMERA, { 0, 0, 0 }, { 0, 0, 0 }, 0.15 },
+
+	{ SL_L_UPPERARM, { 0.005, 0, 0.12 }, { 0.005, 0, 0.43 }, 0.105 },
+	{ SL_R_UPPERARM, { 0.005, 0, 0.12 }, { 0.005, 0, 0.43 }, 0.105 },
+	/* the elbows, then the forearms */
+	{ SL_L_FOREARM, { 0, -0.015, 0 }, { 0, 0.015, 0 }, 0.11 },
+	{ SL_R_FOREARM, { 0, -0.015, 0 }, { 0, 0.015, 0 }, 0.11 },
+	{ SL_L_FOREARM, { 0, 0, 0.2 }, { 0, 0, 0.37 }, 0.095 },
+	{ SL_R_FOREARM, { 0, 0, 0.2 }, { 0, 0, 0.37 }, 0.095 },
+	{ SL_L_WRIST, { 0, 0, 0 }, { 0, 0, 0.06 }, 0.05 },
+	{ SL_R_WRIST, { 0, 0, 0 }, { 0, 0, 0.06 }, 0.05 },
+
+	{ SL_L_UPPERLEG, { -0.07, 0.2, 0 }, { 0.07, 0.2, 0 }, 0.135 },
+	{ SL_R_UPPERLEG, { -0.07, 0.2, 0 }, { 0.07, 0.2, 0 }, 0.135 },
+	{ SL_L_LOWERLEG, { -0.07, -0.12, 0.1 }, { 0.07, -0.12, 0.1 }, 0.16 },
+	{ SL_R_LOWERLEG, { -0.07, -0.12, 0.1 }, { 0.07, -0.12, 0.1 }, 0.16 },
+	/* the ankles, then the soles as a cross */
+	{ SL_L_FOOT, { 0, 0, 0 }, { 0, 0, 0 }, 0.135 },
+	{ SL_R_FOOT, { 0, 0, 0 }, { 0, 0, 0 }, 0.135 },
+	{ SL_L_FOOT, { -0.25, -0.08, 0 }, { 0.25, -0.08, 0 }, 0.1 },
+	{ SL_R_FOOT, { -0.25, -0.08, 0 }, { 0.25, -0.08, 0 }, 0.1 },
+	{ SL_L_FOOT, { 0, -0.08, -0.25 }, { 0, -0.08, 0.25 }, 0.1 },
+	{ SL_R_FOOT, { 0, -0.08, -0.25 }, { 0, -0.08, 0.25 }, 0.1 }
+};
+#define COLLIDE_SHAPES (int)(sizeof(shapes) / sizeof(shapes[0]))
+
+/* this tick's capsules in the robot's frame: the segment from a to 
+ * a + ab, with 1/|ab|^2 (0 for a sphere) for projecting on to it, and 
+ * the box around the whole capsule */
+static struct {
+	float a[3];
+	float ab[3];
+	float inv_length2;
+	float radius;
+	float lo[3];
+	float hi[3];
+} capsules[COLLIDE_SHAPES];
+
+static void collide_one(float *x, float *y, float *z, 
+	float *vx, float *vy, float *vz, int i, const int *near, int count);
+
+/* places the capsules from the joint matrixes.  Call after 
+ * kinematics_think. */
+void collide_think(void) {
+	vec4f a, b;
+	float length2;
+	int c, k;
+
+	for(c=0; c<COLLIDE_SHAPES; c++) {
+		const float *m = joint_matrix(shapes[c].joint);
+		const float r = shapes[c].radius;
+
+		for(k=0; k<3; k++) {
+			a.v[k] = shapes[c].a[k];
+			b.v[k] = shapes[c].b[k];
+		}
+		a.v[3] = b.v[3] = 1;
+		a = m_mult(m, a);
+		b = m_mult(m, b);
+
+		for(k=0; k<3; k++) {
+			capsules[c].a[k] = a.v[k];
+			capsules[c].ab[k] = b.v[k] - a.v[k];
+		}
+		length2 = 0;
+		for(k=0; k<3; k++)
+			length2 += capsules[c].ab[k] * capsules[c].ab[k];
+		capsules[c].inv_length2 = length2 > 0 ? 1 / length2 : 0;
+		capsules[c].radius = r;
+		for(k=0; k<3; k++) {
+			capsules[c].lo[k] = capsules[c].a[k] + 
+				(capsules[c].ab[k] < 0 ? capsules[c].ab[k] : 0) - r;
+			capsules[c].hi[k] = capsules[c].a[k] + 
+				(capsules[c].ab[k] > 0 ? capsules[c].ab[k] : 0) + r;
+		}
+	}
+}
+
+/* pushes particle i out of the capsules in near[0..count) */
+static void collide_one(float *x, float *y, float *z, 
+	float *vx, float *vy, float *vz, int i, const int *near, int count) {
+	float t, dx, dy, dz, d2, d, vn;
+	int k, c;
+
+	for(k=0; k<count; k++) {
+		c = near[k];
+		if ( x[i] <= capsules[c].lo[0] || x[i] >= capsules[c].hi[0] ||
+			y[i] <= capsules[c].lo[1] || y[i] >= capsules[c].hi[1] ||
+			z[i] <= capsules[c].lo[2] || z[i] >= capsules[c].hi[2] )
+			continue;
+		dx = x[i] - capsules[c].a[0];
+		dy = y[i] - capsules[c].a[1];
+		dz = z[i] - capsules[c].a[2];
+		t = (dx * capsules[c].ab[0] + dy * capsules[c].ab[1] + 
+			dz * capsules[c].ab[2]) * capsules[c].inv_length2;
+		if ( t < 0 ) t = 0;
+		if ( t > 1 ) t = 1;
+		dx -= capsules[c].ab[0] * t;
+		dy -= capsules[c].ab[1] * t;
+		dz -= capsules[c].ab[2] * t;
+		d2 = dx*dx + dy*dy + dz*dz;
+		if ( d2 >= capsules[c].radius * capsules[c].radius || d2 == 0 )
+			continue;
+
+		d = sqrtf(d2);
+		dx /= d;
+		dy /= d;
+		dz /= d;
+		x[i] += dx * (capsules[c].radius - d);
+		y[i] += dy * (capsules[c].radius - d);
+		z[i] += dz * (capsules[c].radius - d);
+		vn = vx[i] * dx + vy[i] * dy + vz[i] * dz;
+		if ( vn < 0 ) {
+			vx[i] -= vn * dx;
+			vy[i] -= vn * dy;
+			vz[i] -= vn * dz;
+		}
+	}
+}
+
+/* the vector kernels, one set per vector unit; see collide_kernel.h */
+#ifdef SIMD_X86
+#define COLLIDE_KERNEL(name) name##_sse2
+#define COLLIDE_TARGET SIMD_TARGET("sse2")
+#define COLLIDE_LANES 4
+#define vfloat __m128
+#define V_SET1 _mm_set1_ps
+#define V_LOAD _mm_load_ps
+#define V_STORE _mm_store_ps
+#define V_ADD _mm_add_ps
+#define V_SUB _mm_sub_ps
+#define V_MUL _mm_mul_ps
+#define V_DIV _mm_div_ps
+#define V_MIN _mm_min_ps
+#define V_MAX _mm_max_ps
+#define V_SQRT _mm_sqrt_ps
+#define V_AND _mm_and_ps
+#define V_LT _mm_cmplt_ps
+#define V_SELECT(mask, a, b) \
+	_mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b))
+#define V_ANY _mm_movemask_ps
+#include "collide_kernel.h"
+
+#define COLLIDE_KERNEL(name) name##_avx
+#define COLLIDE_TARGET SIMD_TARGET("avx")
+#define COLLIDE_LANES 8
+#define vfloat __m256
+#define V_SET1 _mm256_set1_ps
+#define V_LOAD _mm256_load_ps
+#define V_STORE _mm256_store_ps
+#define V_ADD _mm256_add_ps
+#define V_SUB _mm256_sub_ps
+#define V_MUL _mm256_mul_ps
+#define V_DIV _mm256_div_ps
+#define V_MIN _mm256_min_ps
+#define V_MAX _mm256_max_ps
+#define V_SQRT _mm256_sqrt_ps
+#define V_AND _mm256_and_ps
+#define V_LT(a, b) _mm256_cmp_ps(a, b, _CMP_LT_OQ)
+#define V_SELECT(mask, a, b) _mm256_blendv_ps(b, a, mask)
+#define V_ANY _mm256_movemask_ps
+#include "collide_kernel.h"
+#endif
+
+/* the kernels in use, and the particles they take at once.  With no 
+ * vector unit everything is left to collide_one. */
+static struct {
+	int lanes;
+	void (*bounds)(const float *x, const float *y, const float *z, 
+		int start, int end, float *lo, float *hi);
+	void (*push)(float *x, float *y, float *z, 
+		float *vx, float *vy, float *vz, int start, int end, 
+		const int *near, int count, const float *lo, const float *hi);
+} kernel = { 1, NULL, NULL };
+
+/* picks the vector unit the kernels use.  The caller checks the CPU has
+ * it. */
+void collide_set_simd(enum simd_level level) {
+	switch ( level ) {
+#ifdef SIMD_X86
+		case SIMD_AVX:
+			kernel.lanes = 8;
+			kernel.bounds = collide_bounds_avx;
+			kernel.push = collide_push_avx;
+			break;
+		case SIMD_SSE2:
+			kernel.lanes = 4;
+			kernel.bounds = collide_bounds_sse2;
+			kernel.push = collide_push_sse2;
+			break;
+#endif
+		default:
+			kernel.lanes = 1;
+			kernel.bounds = NULL;
+			kernel.push = NULL;
+			break;
+	}
+}
+
+/* pushes particles [start, end) out of the robot.  The arrays must be 
+ * aligned for the widest vector unit and start must be a multiple of 
+ * its lanes.  The runs can be done on different threads at once. */
+void collide_particles(float *x, float *y, float *z, 
+	float *vx, float *vy, float *vz, int start, int end) {
+	float lo[3], hi[3], near_lo[3], near_hi[3];
+	int near[COLLIDE_SHAPES];
+	int i, c, k, count, body;
+
+	if ( start >= end )
+		return;
+	body = start;
+	if ( kernel.bounds )
+		body += (end - start) / kernel.lanes * kernel.lanes;
+
+	/* the box around the run */
+	lo[0] = hi[0] = x[start];
+	lo[1] = hi[1] = y[start];
+	lo[2] = hi[2] = z[start];
+	if ( body > start )
+		kernel.bounds(x, y, z, start, body, lo, hi);
+	for(i=body; i<end; i++) {
+		if ( x[i] < lo[0] ) lo[0] = x[i];
+		if ( y[i] < lo[1] ) lo[1] = y[i];
+		if ( z[i] < lo[2] ) lo[2] = z[i];
+		if ( x[i] > hi[0] ) hi[0] = x[i];
+		if ( y[i] > hi[1] ) hi[1] = y[i];
+		if ( z[i] > hi[2] ) hi[2] = z[i];
+	}
+
+	/* the capsules the run might touch, and the box around them */
+	count = 0;
+	for(c=0; c<COLLIDE_SHAPES; c++)
+		if ( lo[0] < capsules[c].hi[0] && hi[0] > capsules[c].lo[0] &&
+			lo[1] < capsules[c].hi[1] && hi[1] > capsules[c].lo[1] &&
+			lo[2] < capsules[c].hi[2] && hi[2] > capsules[c].lo[2] )
+			near[count++] = c;
+	if ( !count )
+		return;
+	for(k=0; k<3; k++) {
+		near_lo[k] = capsules[near[0]].lo[k];
+		near_hi[k] = capsules[near[0]].hi[k];
+		for(c=1; c<count; c++) {
+			if ( capsules[near[c]].lo[k] < near_lo[k] )
+				near_lo[k] = capsules[near[c]].lo[k];
+			if ( capsules[near[c]].hi[k] > near_hi[k] )
+				near_hi[k] = capsules[near[c]].hi[k];
+		}
+	}
+
+	if ( body > start )
+		kernel.push(x, y, z, vx, vy, vz, start, body, near, count, 
+			near_lo, near_hi);
+	for(i=body; i<end; i++)
+		collide_one(x, y, z, vx, vy, vz, i, near, count);
+}
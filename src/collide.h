@@ -0,0 +1,38 @@
+/************************************************************************** 
+ * Nanobot:  A simple, interactive robot rendered using OpenGL
+ * Copyright (C) 2007, Corey Edmunds (corey.edmunds@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *************************************************************************/
+
+
+/**************************************************************************
+ * collide.c/h
+ *
+ * Keeps the smoke out of the robot.  The parts are roughly fitted with
+ * capsules (a line segment and a radius; a sphere is a capsule of no 
+ * length), placed each tick from the kinematics, and particles found 
+ * inside one are pushed out to its surface and lose the part of their
+ * velocity heading in.
+ *************************************************************************/
+#ifndef __COLLIDE_H
+#define __COLLIDE_H
+#include "cpu.h"
+
+void collide_think(void);
+void collide_set_simd(enum simd_level level);
+void collide_particles(float *x, float *y, float *z, 
+	float *vx, float *vy, float *vz, int start, int end);
+#endif
@@ -0,0 +1,168 @@
+/************************************************************************** 
+ * Nanobot:  A simple, interactive robot rendered using OpenGL
+ * Copyright (C) 2007, Corey Edmunds (corey.edmunds@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *************************************************************************/
+
+
+/**************************************************************************
+ * collide_kernel.h
+ *
+ * The vector half of collide.c, written once and built once per vector
+ * unit: collide.c defines the vector type and operations, the number of
+ * lanes, the target and a suffix for the names, then includes this.  
+ * There is no include guard on purpose, and everything it was given is
+ * undefined again at the end, ready for the next vector unit.
+ *
+ * collide.c defines:
+ *   COLLIDE_KERNEL(name)  the name with the vector unit's suffix
+ *   COLLIDE_TARGET        the instructions the kernels may use
+ *   COLLIDE_LANES         floats to a vector
+ *   vfloat                the vector type
+ *   V_SET1 .. V_ANY       the operations on it
+ *************************************************************************/
+
+/* widens lo and hi to take in particles [start, end), which must be 
+ * whole vectors */
+COLLIDE_TARGET
+static void COLLIDE_KERNEL(collide_bounds)(const float *x, const float *y, 
+	const float *z, int start, int end, float *lo, float *hi) {
+	float bound[COLLIDE_LANES];
+	vfloat px, py, pz, lx, ly, lz, hx, hy, hz;
+	int i, k;
+
+	lx = hx = V_LOAD(&x[start]);
+	ly = hy = V_LOAD(&y[start]);
+	lz = hz = V_LOAD(&z[start]);
+	for(i=start+COLLIDE_LANES; i<end; i+=COLLIDE_LANES) {
+		px = V_LOAD(&x[i]);
+		py = V_LOAD(&y[i]);
+		pz = V_LOAD(&z[i]);
+		lx = V_MIN(lx, px);
+		ly = V_MIN(ly, py);
+		lz = V_MIN(lz, pz);
+		hx = V_MAX(hx, px);
+		hy = V_MAX(hy, py);
+		hz = V_MAX(hz, pz);
+	}
+#define REDUCE(v, a, op) \
+	V_STORE(bound, v); \
+	for(k=0; k<COLLIDE_LANES; k++) \
+		if ( bound[k] op a ) a = bound[k];
+	REDUCE(lx, lo[0], <)
+	REDUCE(ly, lo[1], <)
+	REDUCE(lz, lo[2], <)
+	REDUCE(hx, hi[0], >)
+	REDUCE(hy, hi[1], >)
+	REDUCE(hz, hi[2], >)
+#undef REDUCE
+}
+
+/* the lanes of (px, py, pz) inside the open box lo..hi, as a mask */
+#define IN_BOX(lo, hi) V_AND( \
+	V_AND(V_AND(V_LT(V_SET1((lo)[0]), px), V_LT(px, V_SET1((hi)[0]))), \
+		V_AND(V_LT(V_SET1((lo)[1]), py), V_LT(py, V_SET1((hi)[1])))), \
+	V_AND(V_LT(V_SET1((lo)[2]), pz), V_LT(pz, V_SET1((hi)[2]))))
+
+/* pushes particles [start, end), which must be whole vectors, out of the
+ * capsules in near[0..count), which all lie in the box lo..hi */
+COLLIDE_TARGET
+static void COLLIDE_KERNEL(collide_push)(float *x, float *y, float *z, 
+	float *vx, float *vy, float *vz, int start, int end, 
+	const int *near, int count, const float *lo, const float *hi) {
+	const vfloat zero = V_SET1(0);
+	const vfloat one = V_SET1(1);
+	vfloat px, py, pz, qx, qy, qz;
+	vfloat t, dx, dy, dz, d2, d, r, vn, hit;
+	int i, k, c;
+
+	for(i=start; i<end; i+=COLLIDE_LANES) {
+		px = V_LOAD(&x[i]);
+		py = V_LOAD(&y[i]);
+		pz = V_LOAD(&z[i]);
+		if ( !V_ANY(IN_BOX(lo, hi)) )
+			continue;
+		for(k=0; k<count; k++) {
+			c = near[k];
+			hit = IN_BOX(capsules[c].lo, capsules[c].hi);
+			if ( !V_ANY(hit) )
+				continue;
+
+			/* the nearest point on the segment, and the way out */
+			dx = V_SUB(px, V_SET1(capsules[c].a[0]));
+			dy = V_SUB(py, V_SET1(capsules[c].a[1]));
+			dz = V_SUB(pz, V_SET1(capsules[c].a[2]));
+			qx = V_SET1(capsules[c].ab[0]);
+			qy = V_SET1(capsules[c].ab[1]);
+			qz = V_SET1(capsules[c].ab[2]);
+			t = V_MUL(V_ADD(V_ADD(V_MUL(dx, qx), V_MUL(dy, qy)), 
+				V_MUL(dz, qz)), V_SET1(capsules[c].inv_length2));
+			t = V_MIN(V_MAX(t, zero), one);
+			dx = V_SUB(dx, V_MUL(qx, t));
+			dy = V_SUB(dy, V_MUL(qy, t));
+			dz = V_SUB(dz, V_MUL(qz, t));
+			d2 = V_ADD(V_ADD(V_MUL(dx, dx), V_MUL(dy, dy)), V_MUL(dz, dz));
+			r = V_SET1(capsules[c].radius);
+			hit = V_AND(hit, V_AND(V_LT(d2, V_MUL(r, r)), V_LT(zero, d2)));
+			if ( !V_ANY(hit) )
+				continue;
+
+			/* out to the surface.  The lanes that missed work out 
+			 * nonsense (or divide by 0), which the selects zero. */
+			d = V_SQRT(d2);
+			dx = V_SELECT(hit, V_DIV(dx, d), zero);
+			dy = V_SELECT(hit, V_DIV(dy, d), zero);
+			dz = V_SELECT(hit, V_DIV(dz, d), zero);
+			d = V_SUB(r, d);
+			px = V_ADD(px, V_MUL(dx, d));
+			py = V_ADD(py, V_MUL(dy, d));
+			pz = V_ADD(pz, V_MUL(dz, d));
+
+			/* and stop heading in */
+			qx = V_LOAD(&vx[i]);
+			qy = V_LOAD(&vy[i]);
+			qz = V_LOAD(&vz[i]);
+			vn = V_ADD(V_ADD(V_MUL(qx, dx), V_MUL(qy, dy)), V_MUL(qz, dz));
+			vn = V_MIN(vn, zero);
+			V_STORE(&vx[i], V_SUB(qx, V_MUL(vn, dx)));
+			V_STORE(&vy[i], V_SUB(qy, V_MUL(vn, dy)));
+			V_STORE(&vz[i], V_SUB(qz, V_MUL(vn, dz)));
+			V_STORE(&x[i], px);
+			V_STORE(&y[i], py);
+			V_STORE(&z[i], pz);
+		}
+	}
+}
+
+#undef IN_BOX
+#undef COLLIDE_KERNEL
+#undef COLLIDE_TARGET
+#undef COLLIDE_LANES
+#undef vfloat
+#undef V_SET1
+#undef V_LOAD
+#undef V_STORE
+#undef V_ADD
+#undef V_SUB
+#undef V_MUL
+#undef V_DIV
+#undef V_MIN
+#undef V_MAX
+#undef V_SQRT
+#undef V_AND
+#undef V_LT
+#undef V_SELECT
+#undef V_ANY
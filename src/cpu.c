@@ -0,0 +1,65 @@
+/************************************************************************** 
+ * Nanobot:  A simple, interactive robot rendered using OpenGL
+ * Copyright (C) 2007, Corey Edmunds (corey.edmunds@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *************************************************************************/
+
+
+/**************************************************************************
+ * cpu.c/h
+ *
+ * Which vector units the CPU has.  The hot kernels are built once for 
+ * each vector unit in to the one binary, each function marked with the 
+ * instructions it may use, and the best one the CPU can run is picked 
+ * when the program starts (or whichever one the user asks for).  So one
+ * build runs everywhere and can be timed with each kernel.
+ *************************************************************************/
+#include "cpu.h"
+
+static const char *names[SIMD_LEVELS] = { "c", "sse2", "avx" };
+
+/* whether kernels for level are built in and the CPU can run them */
+int simd_supported(enum simd_level level) {
+	switch ( level ) {
+		case SIMD_NONE:
+			return 1;
+#ifdef SIMD_X86
+		case SIMD_SSE2:
+			return __builtin_cpu_supports("sse2");
+		case SIMD_AVX:
+			return __builtin_cpu_supports("avx");
+#endif
+		default:
+			return 0;
+	}
+}
+
+/* the best vector unit there are kernels for and the CPU has */
+enum simd_level simd_best(void) {
+	int level;
+
+	for(level=SIMD_LEVELS-1; level>SIMD_NONE; level--)
+		if ( simd_supported(level) )
+			break;
+	return level;
+}
+
+/* the name of level, as --simd takes it */
+const char *simd_name(enum simd_level level) {
+	if ( level < SIMD_NONE || level >= SIMD_LEVELS )
+		return "?";
+	return names[level];
+}
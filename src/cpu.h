@@ -0,0 +1,52 @@
+/************************************************************************** 
+ * Nanobot:  A simple, interactive robot rendered using OpenGL
+ * Copyright (C) 2007, Corey Edmunds (corey.edmunds@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *************************************************************************/
+
+
+/**************************************************************************
+ * cpu.c/h
+ *
+ * Which vector units the CPU has.  The hot kernels are built once for 
+ * each vector unit in to the one binary, each function marked with the 
+ * instructions it may use, and the best one the CPU can run is picked 
+ * when the program starts (or whichever one the user asks for).  So one
+ * build runs everywhere and can be timed with each kernel.
+ *************************************************************************/
+#ifndef __CPU_H
+#define __CPU_H
+
+/* the vector units, worst to best.  SIMD_NONE is plain C. */
+enum simd_level {
+	SIMD_NONE,
+	SIMD_SSE2,
+	SIMD_AVX,
+	SIMD_LEVELS
+};
+
+/* SIMD_X86 is defined when the SSE2 and AVX kernels are built in, and
+ * SIMD_TARGET marks a function as allowed to use an instruction set 
+ * the rest of the build doesn't assume. */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#define SIMD_X86
+	#define SIMD_TARGET(t) __attribute__((target(t)))
+#endif
+
+int simd_supported(enum simd_level level);
+enum simd_level simd_best(void);
+const char *simd_name(enum simd_level level);
+#endif
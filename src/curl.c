@@ -0,0 +1,228 @@
+/************************************************************************** 
+ * Nanobot:  A simple, interactive robot rendered using OpenGL
+ * Copyright (C) 2007, Corey Edmunds (corey.edmunds@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *************************************************************************/
+
+
+/**************************************************************************
+ * curl.c/h
+ *
+ * A turbulence field for the smoke: the curl of a smooth, tileable 
+ * noise, baked once in to a small 3D grid of velocities.  A curl has no
+ * divergence, so smoke carried along it swirls without bunching up or 
+ * thinning out.  Evaluating the noise per particle per tick would cost 
+ * far too much; looking the baked field up costs one trilinear gather.
+ * The grid tiles, so it covers all of space.
+ *
+ * The noise is value noise: random numbers on a coarse lattice, 
+ * smoothly interpolated, in two octaves whose lattices both divide the 
+ * grid so the result wraps round seamlessly.  One noise for each axis 
+ * makes the vector potential, and the field is its curl by central 
+ * differences.  Both passes run a z slab per worker job.
+ *************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "curl.h"
+#include "rng.h"
+#include "workers.h"
+
+#define CURL_CELLS (CURL_SIZE * CURL_SIZE * CURL_SIZE)
+#define CURL_MASK (CURL_SIZE - 1)
+/* the noise lattices: the points along a side of each octave and its 
+ * weight.  The points must divide CURL_SIZE. */
+#define CURL_OCTAVES 2
+static const int lattice_points[CURL_OCTAVES] = { 4, 8 };
+static const float lattice_weight[CURL_OCTAVES] = { 1, 0.5f };
+
+/* the index of cell (x, y, z), wrapping round */
+#define CELL(x, y, z) ((((z) & CURL_MASK) * CURL_SIZE + ((y) & CURL_MASK)) \
+	* CURL_SIZE + ((x) & CURL_MASK))
+
+/* the baked velocities, 3 to a cell so a lookup reads them together.  In
+ * cells per unit of potential, until init_curl scales them. */
+static float *field;
+/* the seed the field was baked from */
+static uint64_t field_seed;
+/* while baking: the lattices (3 axes of each octave) and the potential */
+static float *lattice[CURL_OCTAVES][3];
+static float *potential[3];
+
+static void curl_potential_slab(int z, void *arg);
+static void curl_field_slab(int z, void *arg);
+
+/* the octave o noise for axis a at cell (x, y, z) */
+static float curl_noise(int o, int a, int x, int y, int z) {
+	const int n = lattice_points[o];
+	const float span = (float)CURL_SIZE / n;
+	const float *l = lattice[o][a];
+	float p[3], f[3], c00, c10, c01, c11;
+	int i[3], j[3], k;
+
+	p[0] = x / span;
+	p[1] = y / span;
+	p[2] = z / span;
+	for(k=0; k<3; k++) {
+		i[k] = p[k];
+		f[k] = p[k] - i[k];
+		/* smoothstep, so the potential has a smooth slope */
+		f[k] = f[k] * f[k] * (3 - 2 * f[k]);
+		j[k] = (i[k] + 1) % n;
+	}
+#define L(x, y, z) l[((z) * n + (y)) * n + (x)]
+	c00 = L(i[0], i[1], i[2]) + (L(j[0], i[1], i[2]) - L(i[0], i[1], i[2])) * f[0];
+	c10 = L(i[0], j[1], i[2]) + (L(j[0], j[1], i[2]) - L(i[0], j[1], i[2])) * f[0];
+	c01 = L(i[0], i[1], j[2]) + (L(j[0], i[1], j[2]) - L(i[0], i[1], j[2])) * f[0];
+	c11 = L(i[0], j[1], j[2]) + (L(j[0], j[1], j[2]) - L(i[0], j[1], j[2])) * f[0];
+#undef L
+	c00 += (c10 - c00) * f[1];
+	c01 += (c11 - c01) * f[1];
+	return c00 + (c01 - c00) * f[2];
+}
+
+/* works out the potential for one z slab.  Run on the worker threads. */
+static void curl_potential_slab(int z, void *arg) {
+	float v;
+	int x, y, a, o;
+
+	if ( arg ) arg = arg; /* shut up compiler */
+	for(a=0; a<3; a++)
+		for(y=0; y<CURL_SIZE; y++)
+			for(x=0; x<CURL_SIZE; x++) {
+				v = 0;
+				for(o=0; o<CURL_OCTAVES; o++)
+					v += curl_noise(o, a, x, y, z) * lattice_weight[o];
+				potential[a][CELL(x, y, z)] = v;
+			}
+}
+
+/* works out the curl of the potential for one z slab.  Run on the 
+ * worker threads. */
+static void curl_field_slab(int z, void *arg) {
+	const float **p = (const float **)potential;
+	float *out;
+	int x, y;
+
+	if ( arg ) arg = arg; /* shut up compiler */
+	for(y=0; y<CURL_SIZE; y++)
+		for(x=0; x<CURL_SIZE; x++) {
+			out = &field[CELL(x, y, z) * 3];
+			out[0] = (p[2][CELL(x, y+1, z)] - p[2][CELL(x, y-1, z)]) -
+				(p[1][CELL(x, y, z+1)] - p[1][CELL(x, y, z-1)]);
+			out[1] = (p[0][CELL(x, y, z+1)] - p[0][CELL(x, y, z-1)]) -
+				(p[2][CELL(x+1, y, z)] - p[2][CELL(x-1, y, z)]);
+			out[2] = (p[1][CELL(x+1, y, z)] - p[1][CELL(x-1, y, z)]) -
+				(p[0][CELL(x, y+1, z)] - p[0][CELL(x, y-1, z)]);
+		}
+}
+
+/* bakes the field, from the program wide seed, or again if the seed has
+ * changed since (a snapshot was restored).  The velocities are scaled so
+ * their RMS speed is 1.  Returns 0 on failure. */
+int init_curl(void) {
+	rng_t rng;
+	double sum;
+	float scale;
+	int o, a, n, i, ok = 0;
+
+	if ( field && field_seed == rng_get_seed() )
+		return 1;
+	field_seed = rng_get_seed();
+	if ( !field )
+		field = malloc(sizeof(float) * 3 * CURL_CELLS);
+	for(a=0; a<3; a++)
+		potential[a] = malloc(sizeof(float) * CURL_CELLS);
+	if ( !field || !potential[0] || !potential[1] || !potential[2] ) {
+		printf("%s %d:  out of memory for the turbulence field\n", 
+			__FILE__, __LINE__);
+		goto done;
+	}
+
+	rng_stream(&rng, rng_get_seed(), RNG_CURL);
+	for(o=0; o<CURL_OCTAVES; o++)
+		for(a=0; a<3; a++) {
+			n = lattice_points[o];
+			lattice[o][a] = malloc(sizeof(float) * n * n * n);
+			if ( !lattice[o][a] )
+				goto done;
+			rng_fill(&rng, lattice[o][a], n * n * n);
+			for(i=0; i<n*n*n; i++)
+				lattice[o][a][i] = lattice[o][a][i] * 2 - 1;
+		}
+
+	workers_run(CURL_SIZE, curl_potential_slab, NULL);
+	workers_run(CURL_SIZE, curl_field_slab, NULL);
+
+	sum = 0;
+	for(i=0; i<3*CURL_CELLS; i++)
+		sum += field[i] * field[i];
+	scale = sum > 0 ? 1 / sqrt(sum / CURL_CELLS) : 0;
+	for(i=0; i<3*CURL_CELLS; i++)
+		field[i] *= scale;
+
+	ok = 1;
+
+done:
+	for(o=0; o<CURL_OCTAVES; o++)
+		for(a=0; a<3; a++) {
+			free(lattice[o][a]);
+			lattice[o][a] = NULL;
+		}
+	for(a=0; a<3; a++) {
+		free(potential[a]);
+		potential[a] = NULL;
+	}
+	if ( !ok ) {
+		free(field);
+		field = NULL;
+	}
+	return ok;
+}
+
+/* looks the velocity up at world position (x, y, z), trilinearly, in to
+ * out[3].  The field must have been baked. */
+void curl_sample(float x, float y, float z, float *out) {
+	const float scale = 1 / CURL_CELL;
+	const float *c000, *c100, *c010, *c110, *c001, *c101, *c011, *c111;
+	float fx, fy, fz, a, b;
+	int ix, iy, iz, k;
+
+	x *= scale;
+	y *= scale;
+	z *= scale;
+	ix = floorf(x);
+	iy = floorf(y);
+	iz = floorf(z);
+	fx = x - ix;
+	fy = y - iy;
+	fz = z - iz;
+	c000 = &field[CELL(ix, iy, iz) * 3];
+	c100 = &field[CELL(ix+1, iy, iz) * 3];
+	c010 = &field[CELL(ix, iy+1, iz) * 3];
+	c110 = &field[CELL(ix+1, iy+1, iz) * 3];
+	c001 = &field[CELL(ix, iy, iz+1) * 3];
+	c101 = &field[CELL(ix+1, iy, iz+1) * 3];
+	c011 = &field[CELL(ix, iy+1, iz+1) * 3];
+	c111 = &field[CELL(ix+1, iy+1, iz+1) * 3];
+	for(k=0; k<3; k++) {
+		a = (c000[k] + (c100[k] - c000[k]) * fx) * (1 - fy) + 
+			(c010[k] + (c110[k] - c010[k]) * fx) * fy;
+		b = (c001[k] + (c101[k] - c001[k]) * fx) * (1 - fy) + 
+			(c011[k] + (c111[k] - c011[k]) * fx) * fy;
+		out[k] = a + (b - a) * fz;
+	}
+}
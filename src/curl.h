@@ -0,0 +1,40 @@
+/************************************************************************** 
+ * Nanobot:  A simple, interactive robot rendered using OpenGL
+ * Copyright (C) 2007, Corey Edmunds (corey.edmunds@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *************************************************************************/
+
+
+/**************************************************************************
+ * curl.c/h
+ *
+ * A turbulence field for the smoke: the curl of a smooth, tileable 
+ * noise, baked once in to a small 3D grid of velocities.  A curl has no
+ * divergence, so smoke carried along it swirls without bunching up or 
+ * thinning out.  Evaluating the noise per particle per tick would cost 
+ * far too much; looking the baked field up costs one trilinear gather.
+ * The grid tiles, so it covers all of space.
+ *************************************************************************/
+#ifndef __CURL_H
+#define __CURL_H
+
+/* the field is CURL_SIZE cells along each side, each CURL_CELL across */
+#define CURL_SIZE 32
+#define CURL_CELL 0.125f
+
+int init_curl(void);
+void curl_sample(float x, float y, float z, float *out);
+#endif
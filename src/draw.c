@@ -174,13 +174,17 @@ void draw_panel(void) {
 		case ANIM_WALK:
 			mode = "walking";
 			break;
+		case ANIM_CLIP:
+			mode = "playing a clip";
+			break;
 		default:
 			mode = "confused";
 			break;
 	}
 
 	/* draw the panel text */
-	snprintf(buf, sizeof(buf), "Nanobot is %s", mode);
+	snprintf(buf, sizeof(buf), "Nanobot is %s%s", mode, 
+		get_recording() ? " (recording)" : "");
 	draw_string(10, y, GLUT_BITMAP_8_BY_13, buf);
 
 	/* re-enable lights */
@@ -0,0 +1,168 @@
+/************************************************************************** 
+ * Nanobot:  A simple, interactive robot rendered using OpenGL
+ * Copyright (C) 2007, Corey Edmunds (corey.edmunds@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *************************************************************************/
+
+
+/**************************************************************************
+ * emitter.c/h
+ *
+ * Particle emitters.  An emitter is a point that gives off smoke at some
+ * rate, in some colour, with a budget on how much of its smoke may be 
+ * alive at once.  It can be attached to a joint, in which case its 
+ * position and direction are in that joint's frame and follow the joint
+ * about; emitters_think moves them after kinematics_think each tick.
+ *
+ * The particle system does the emitting.  It counts each emitter's live
+ * particles in emitter_t.live, which is why a slot is not reused until
+ * the smoke from its last owner has died away.
+ *************************************************************************/
+#include "emitter.h"
+#include "kinematics.h"
+#include <string.h>
+
+emitter_t emitters[MAX_EMITTERS];
+
+/* makes a new emitter, detached, at the robot's origin, giving off 
+ * nothing.  Returns its id, or -1 if there are no free emitters. */
+int emitter_create(void) {
+	emitter_t *e;
+	int id;
+
+	for(id=0; id<MAX_EMITTERS; id++) {
+		e = &emitters[id];
+		if ( e->used || e->live )
+			continue;
+		memset(e, 0, sizeof(emitter_t));
+		e->used = 1;
+		e->joint = -1;
+		e->color[0] = e->color[1] = e->color[2] = 1;
+		return id;
+	}
+	return -1;
+}
+
+/* stops an emitter.  Its smoke lives out its life. */
+void emitter_destroy(int id) {
+	if ( id < 0 || id >= MAX_EMITTERS )
+		return;
+	emitters[id].used = 0;
+}
+
+/* places an emitter at offset in joint's frame, giving off smoke with
+ * the velocity direction (also in joint's frame).  A joint of -1 leaves
+ * the emitter in the robot's frame. */
+void emitter_attach(int id, int joint, const float *offset, 
+		const float *direction) {
+	emitter_t *e;
+
+	if ( id < 0 || id >= MAX_EMITTERS || joint >= JOINTCOUNT )
+		return;
+	e = &emitters[id];
+	e->joint = joint < 0 ? -1 : joint;
+	memcpy(e->offset, offset, sizeof(e->offset));
+	memcpy(e->direction, direction, sizeof(e->direction));
+}
+
+/* sets the number of particles an emitter gives off per tick.  Fractions
+ * carry over from tick to tick. */
+void emitter_set_rate(int id, float rate) {
+	if ( id < 0 || id >= MAX_EMITTERS )
+		return;
+	emitters[id].rate = rate < 0 ? 0 : rate;
+}
+
+/* sets the most particles an emitter may have alive at once.  0 means
+ * it is only limited by the pool. */
+void emitter_set_budget(int id, int budget) {
+	if ( id < 0 || id >= MAX_EMITTERS )
+		return;
+	emitters[id].budget = budget < 0 ? 0 : budget;
+}
+
+/* sets an emitter's smoke colour */
+void emitter_set_color(int id, const float *color) {
+	if ( id < 0 || id >= MAX_EMITTERS )
+		return;
+	memcpy(emitters[id].color, color, sizeof(emitters[id].color));
+}
+
+/* moves the emitters to where their joints are this tick */
+void emitters_think(void) {
+	static const float identity[16] = { 
+		1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0,  0, 0, 0, 1 
+	};
+	const float *m;
+	emitter_t *e;
+	int id, i;
+
+	for(id=0; id<MAX_EMITTERS; id++) {
+		e = &emitters[id];
+		if ( !e->used )
+			continue;
+		m = e->joint < 0 ? identity : joint_matrix(e->joint);
+		for(i=0; i<3; i++) {
+			e->position[i] = m[i] * e->offset[0] + 
+				m[4+i] * e->offset[1] + 
+				m[8+i] * e->offset[2] + m[12+i];
+			e->velocity[i] = m[i] * e->direction[0] + 
+				m[4+i] * e->direction[1] + 
+				m[8+i] * e->direction[2];
+		}
+	}
+}
+
+/* writes the emitters to a snapshot */
+void emitters_save(snapshot_writer *w) {
+	snapshot_begin(w, SNAP_EMITTERS);
+	snapshot_write(w, emitters, sizeof(emitters));
+	snapshot_end(w);
+}
+
+/* finds the emitters in a snapshot.  Returns NULL if it has none, or 
+ * one is attached to a joint that isn't there. */
+static const emitter_t *emitters_find(const snapshot_t *s) {
+	snapshot_reader r;
+	const emitter_t *saved;
+	int id;
+
+	if ( !snapshot_find(s, SNAP_EMITTERS, &r) )
+		return NULL;
+	saved = snapshot_read(&r, sizeof(emitters));
+	if ( !saved )
+		return NULL;
+	for(id=0; id<MAX_EMITTERS; id++)
+		if ( saved[id].joint < -1 || saved[id].joint >= JOINTCOUNT )
+			return NULL;
+	return saved;
+}
+
+/* checks the snapshot's emitters can be restored, without restoring 
+ * them */
+int emitters_check(const snapshot_t *s) {
+	return emitters_find(s) != NULL;
+}
+
+/* restores the emitters from a snapshot.  Returns 0 if it has none. */
+int emitters_restore(const snapshot_t *s) {
+	const emitter_t *saved;
+
+	if ( !(saved = emitters_find(s)) )
+		return 0;
+	memcpy(emitters, saved, sizeof(emitters));
+	return 1;
+}
@@ -0,0 +1,67 @@
+/************************************************************************** 
+ * Nanobot:  A simple, interactive robot rendered using OpenGL
+ * Copyright (C) 2007, Corey Edmunds (corey.edmunds@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *************************************************************************/
+
+
+/**************************************************************************
+ * emitter.c/h
+ *
+ * Particle emitters.  An emitter is a point that gives off smoke at some
+ * rate, in some colour, with a budget on how much of its smoke may be 
+ * alive at once.  It can be attached to a joint, in which case its 
+ * position and direction are in that joint's frame and follow the joint
+ * about; emitters_think moves them after kinematics_think each tick.
+ *************************************************************************/
+#ifndef __EMITTER_H
+#define __EMITTER_H
+#include "joint.h"
+#include "snapshot.h"
+
+#define MAX_EMITTERS 32
+
+/* an emitter.  The position and velocity are in the robot's frame, and 
+ * worked out from the offset and direction by emitters_think. */
+typedef struct {
+	int used;
+	int joint;
+	float offset[3];
+	float direction[3];
+	float rate;
+	float owed;
+	int budget;
+	int live;
+	float color[3];
+
+	float position[3];
+	float velocity[3];
+} emitter_t;
+
+extern emitter_t emitters[MAX_EMITTERS];
+
+int emitter_create(void);
+void emitter_destroy(int id);
+void emitter_attach(int id, int joint, const float *offset, 
+	const float *direction);
+void emitter_set_rate(int id, float rate);
+void emitter_set_budget(int id, int budget);
+void emitter_set_color(int id, const float *color);
+void emitters_think(void);
+void emitters_save(snapshot_writer *w);
+int emitters_check(const snapshot_t *s);
+int emitters_restore(const snapshot_t *s);
+#endif
@@ -0,0 +1,219 @@
+/************************************************************************** 
+ * Nanobot:  A simple, interactive robot rendered using OpenGL
+ * Copyright (C) 2007, Corey Edmunds (corey.edmunds@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *************************************************************************/
+
+
+/**************************************************************************
+ * grid.c/h
+ *
+ * A uniform spatial hash for finding particles near a point.  Space is
+ * cut in to cubic cells, and each cell hashes to a bucket by the Morton
+ * code of its coordinates, so cells that are near each other in space
+ * are mostly near each other in the table too.  The grid is rebuilt 
+ * from scratch each time with a counting sort: the particles are 
+ * counted per bucket, the counts summed in to starting points, and the
+ * particle indexes scattered in to one array, bucket by bucket.  The
+ * positions are scattered alongside, so a query reads straight through
+ * memory instead of jumping about the particles.
+ *
+ * Cells far apart can share a bucket, so a query can turn up particles
+ * that are not near at all; callers check the distance.
+ *************************************************************************/
+#include "grid.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/* spreads the low 10 bits of v out to every third bit */
+static unsigned int morton_spread(unsigned int v) {
+	v &= 0x3ff;
+	v = (v | (v << 16)) & 0x030000ff;
+	v = (v | (v << 8)) & 0x0300f00f;
+	v = (v | (v << 4)) & 0x030c30c3;
+	v = (v | (v << 2)) & 0x09249249;
+	return v;
+}
+
+/* the bucket of cell (x, y, z) */
+static unsigned int grid_bucket(const spatial_grid *g, int x, int y, int z) {
+	return (morton_spread(x) | morton_spread(y) << 1 | 
+		morton_spread(z) << 2) & g->mask;
+}
+
+/* GRID_MIN_BUCKETS keeps the low two bits of each coordinate in the 
+ * bucket.  Three cells in a row always differ in those bits, so the 27
+ * cells around any cell land in 27 different buckets. */
+#define GRID_MIN_BUCKETS 64
+
+/* sets up a grid of cells cell units across, for up to capacity 
+ * particles.  There are at least twice as many buckets as particles.
+ * Returns 0 on failure. */
+int grid_init(spatial_grid *g, float cell, int capacity) {
+	unsigned int buckets = GRID_MIN_BUCKETS;
+
+	while ( buckets < (unsigned int)capacity * 2 )
+		buckets <<= 1;
+	g->inv_cell = 1 / cell;
+	g->mask = buckets - 1;
+	g->capacity = capacity;
+	g->count = 0;
+	g->start = calloc(buckets + 1, sizeof(unsigned int));
+	g->block = malloc((sizeof(unsigned int) * 2 + sizeof(float) * 3) * 
+		(size_t)capacity);
+	if ( !g->start || !g->block ) {
+		grid_free(g);
+		return 0;
+	}
+	g->entries = g->block;
+	g->keys = g->entries + capacity;
+	g->x = (float*)(g->keys + capacity);
+	g->y = g->x + capacity;
+	g->z = g->y + capacity;
+	return 1;
+}
+
+/* frees a grid.  Freeing a zeroed grid does nothing. */
+void grid_free(spatial_grid *g) {
+	free(g->start);
+	free(g->block);
+	g->start = g->entries = g->keys = NULL;
+	g->x = g->y = g->z = NULL;
+	g->block = NULL;
+	g->capacity = 0;
+	g->count = 0;
+}
+
+/* puts particles [0, count) in to the grid, with the positions given in
+ * x, y and z.  count must be no more than the capacity. */
+void grid_build(spatial_grid *g, const float *x, const float *y, 
+		const float *z, int count) {
+	unsigned int *start = g->start;
+	unsigned int sum, n, e;
+	int i;
+
+	if ( count > g->capacity )
+		count = g->capacity;
+	g->count = count;
+
+	/* count, leaving each bucket's count one along so the sum comes out
+	 * as each bucket's start */
+	memset(start, 0, sizeof(unsigned int) * (g->mask + 2));
+	for(i=0; i<count; i++) {
+		g->keys[i] = grid_bucket(g, floorf(x[i] * g->inv_cell), 
+			floorf(y[i] * g->inv_cell), floorf(z[i] * g->inv_cell));
+		start[g->keys[i] + 1]++;
+	}
+	for(sum=0, n=0; n<=g->mask + 1; n++) {
+		sum += start[n];
+		start[n] = sum;
+	}
+
+	/* scatter, using start[b] as bucket b's next free entry.  That 
+	 * leaves it at the start of bucket b + 1, so shift back after. */
+	for(i=0; i<count; i++) {
+		e = start[g->keys[i]]++;
+		g->entries[e] = i;
+		g->x[e] = x[i];
+		g->y[e] = y[i];
+		g->z[e] = z[i];
+	}
+	memmove(start + 1, start, sizeof(unsigned int) * (g->mask + 1));
+	start[0] = 0;
+}
+
+/* the 27 cells around a cell, nearest first: the cell itself, then the
+ * ones sharing a face, an edge and a corner with it */
+static const signed char around[GRID_CELLS][3] = {
+	{0,0,0},
+	{-1,0,0}, {1,0,0}, {0,-1,0}, {0,1,0}, {0,0,-1}, {0,0,1},
+	{-1,-1,0}, {1,-1,0}, {-1,1,0}, {1,1,0}, 
+	{-1,0,-1}, {1,0,-1}, {-1,0,1}, {1,0,1}, 
+	{0,-1,-1}, {0,1,-1}, {0,-1,1}, {0,1,1},
+	{-1,-1,-1}, {1,-1,-1}, {-1,1,-1}, {1,1,-1}, 
+	{-1,-1,1}, {1,-1,1}, {-1,1,1}, {1,1,1}
+};
+
+/* finds the buckets of the cells around (x, y, z) that could hold a 
+ * particle within radius of it (no more than the cell size), and 
+ * returns how many were not empty.  They are put in cells, nearest 
+ * first, which must have room for GRID_CELLS.  The Morton code of each
+ * cell is put together from coordinates spread once each. */
+int grid_cells(const spatial_grid *g, float x, float y, float z, 
+		float radius, grid_range *cells) {
+	float p[3] = { x * g->inv_cell, y * g->inv_cell, z * g->inv_cell };
+	float r2 = radius * g->inv_cell * radius * g->inv_cell;
+	float gap[3][3];
+	unsigned int spread[3][3];
+	unsigned int b;
+	float d2;
+	int n = 0;
+	int a, i, c;
+
+	/* the distance, in cells, to the near side of the cells on either
+	 * side along each axis */
+	for(a=0; a<3; a++) {
+		c = floorf(p[a]);
+		gap[a][0] = p[a] - c;
+		gap[a][1] = 0;
+		gap[a][2] = c + 1 - p[a];
+		for(i=0; i<3; i++)
+			spread[a][i] = morton_spread(c + i - 1) << a;
+	}
+	for(i=0; i<GRID_CELLS; i++) {
+		const signed char *o = around[i];
+
+		d2 = gap[0][o[0]+1] * gap[0][o[0]+1] + 
+			gap[1][o[1]+1] * gap[1][o[1]+1] + 
+			gap[2][o[2]+1] * gap[2][o[2]+1];
+		if ( d2 >= r2 )
+			continue;
+		b = (spread[0][o[0]+1] | spread[1][o[1]+1] | spread[2][o[2]+1]) 
+			& g->mask;
+		if ( g->start[b] == g->start[b+1] )
+			continue;
+		cells[n].start = g->start[b];
+		cells[n].end = g->start[b+1];
+		n++;
+	}
+	return n;
+}
+
+/* finds up to max particles within radius of (px, py, pz), as of the 
+ * last grid_build, and puts their indexes in out.  radius should be no 
+ * more than the cell size.  Returns how many were found. */
+int grid_neighbors(const spatial_grid *g, float px, float py, float pz, 
+		float radius, int *out, int max) {
+	grid_range cells[GRID_CELLS];
+	float dx, dy, dz;
+	unsigned int e;
+	int ncells, c, n = 0;
+
+	ncells = grid_cells(g, px, py, pz, radius, cells);
+	for(c=0; c<ncells; c++)
+		for(e=cells[c].start; e<cells[c].end; e++) {
+			dx = g->x[e] - px;
+			dy = g->y[e] - py;
+			dz = g->z[e] - pz;
+			if ( dx*dx + dy*dy + dz*dz > radius * radius )
+				continue;
+			out[n++] = g->entries[e];
+			if ( n == max )
+				return n;
+		}
+	return n;
+}
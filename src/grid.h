@@ -0,0 +1,74 @@
+/************************************************************************** 
+ * Nanobot:  A simple, interactive robot rendered using OpenGL
+ * Copyright (C) 2007, Corey Edmunds (corey.edmunds@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *************************************************************************/
+
+
+/**************************************************************************
+ * grid.c/h
+ *
+ * A uniform spatial hash for finding particles near a point.  Space is
+ * cut in to cubic cells, and each cell hashes to a bucket by the Morton
+ * code of its coordinates, so cells that are near each other in space
+ * are mostly near each other in the table too.  The grid is rebuilt 
+ * from scratch each time with a counting sort: the particles are 
+ * counted per bucket, the counts summed in to starting points, and the
+ * particle indexes scattered in to one array, bucket by bucket.  The
+ * positions are scattered alongside, so a query reads straight through
+ * memory instead of jumping about the particles.
+ *
+ * Cells far apart can share a bucket, so a query can turn up particles
+ * that are not near at all; callers check the distance.
+ *************************************************************************/
+#ifndef __GRID_H
+#define __GRID_H
+
+/* a spatial hash.  The indexes of the particles in bucket b are 
+ * entries[start[b]] to entries[start[b+1] - 1], and x, y and z hold 
+ * their positions in the same order. */
+typedef struct {
+	float inv_cell;
+	unsigned int mask;
+	unsigned int *start;
+	unsigned int *entries;
+	unsigned int *keys;
+	float *x;
+	float *y;
+	float *z;
+	void *block;
+	int capacity;
+	int count;
+} spatial_grid;
+
+/* a run of entries, from one bucket */
+typedef struct {
+	unsigned int start;
+	unsigned int end;
+} grid_range;
+
+/* the most ranges grid_cells can return */
+#define GRID_CELLS 27
+
+int grid_init(spatial_grid *g, float cell, int capacity);
+void grid_free(spatial_grid *g);
+void grid_build(spatial_grid *g, const float *x, const float *y, 
+	const float *z, int count);
+int grid_cells(const spatial_grid *g, float x, float y, float z, 
+	float radius, grid_range *cells);
+int grid_neighbors(const spatial_grid *g, float px, float py, float pz, 
+	float radius, int *out, int max);
+#endif
@@ -0,0 +1,363 @@
+/************************************************************************** 
+ * Nanobot:  A simple, interactive robot rendered using OpenGL
+ * Copyright (C) 2007, Corey Edmunds (corey.edmunds@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *************************************************************************/
+
+
+/**************************************************************************
+ * ik.c/h
+ *
+ * Inverse kinematics for the arms and legs: works out the angles that 
+ * put the end of a limb (the wrist, or the ankle) on a target.  Each 
+ * limb is a two-axis joint at the shoulder or hip and a hinge at the 
+ * elbow or knee, so it is solved with a two-bone solution first; when
+ * the joint limits stop that reaching, a few rounds of cyclic coordinate
+ * descent (CCD) get as close as the limits allow.
+ *
+ * Nothing here keeps any state, and the work per limb is fixed, so it
+ * can be run on any number of poses every tick.
+ *************************************************************************/
+#include <math.h>
+#include "ik.h"
+#include "kinematics.h"
+
+/* how near the end has to get, and how many rounds of CCD it gets to 
+ * do it in when the two-bone solution falls short */
+#define IK_TOLERANCE 0.001
+#define IK_ROUNDS 8
+
+/* one of the angles a limb turns by: joint's angle about the x (0), y (1)
+ * or z (2) axis of the frame it turns in */
+typedef struct {
+	enum joint_label joint;
+	enum joint_axis angle;
+	int about;
+} ik_turn;
+
+/* a limb.  The root turns by turn[0] and then turn[1] about its pivot,
+ * which moves upper and the rest of the limb; the hinge at the end of
+ * upper turns by turn[2], which moves lower.  The lengths are the ones
+ * kinematics.c mounts the parts with. */
+typedef struct {
+	ik_turn turn[3];
+	float pivot[3];	/* where the root turns, in its base frame */
+	float upper[3];	/* the pivot to the hinge */
+	float lower[3];	/* the hinge to the end */
+} ik_chain;
+
+static const ik_chain chains[IK_LIMBS] = {
+	{ /* IK_L_ARM: the shoulder rolls and then lifts, the elbow bends */
+		{
+			{ SL_L_UPPERARM, AXIS_Y, 2 },
+			{ SL_L_UPPERARM, AXIS_X, 0 },
+			{ SL_L_FOREARM, AXIS_Y, 1 }
+		},
+		{ 0, 0, 0.125 }, { 0.005, 0, 0.525 }, { 0, 0, 0.46 }
+	},
+	{ /* IK_R_ARM */
+		{
+			{ SL_R_UPPERARM, AXIS_Y, 2 },
+			{ SL_R_UPPERARM, AXIS_X, 0 },
+			{ SL_R_FOREARM, AXIS_Y, 1 }
+		},
+		{ 0, 0, 0.125 }, { 0.005, 0, 0.525 }, { 0, 0, 0.46 }
+	},
+	{ /* IK_L_LEG: the hip swings and then lifts, the knee bends */
+		{
+			{ SL_L_UPPERLEG, AXIS_X, 1 },
+			{ SL_L_UPPERLEG, AXIS_Y, 0 },
+			{ SL_L_LOWERLEG, AXIS_Y, 0 }
+		},
+		{ 0, 0, 0 }, { -0.025, -0.31, -0.135 }, { 0, -0.292, 0.135 }
+	},
+	{ /* IK_R_LEG */
+		{
+			{ SL_R_UPPERLEG, AXIS_X, 1 },
+			{ SL_R_UPPERLEG, AXIS_Y, 0 },
+			{ SL_R_LOWERLEG, AXIS_Y, 0 }
+		},
+		{ 0, 0, 0 }, { 0.025, -0.31, -0.135 }, { 0, -0.292, 0.135 }
+	}
+};
+
+/* the x, y and z axes */
+static const float axes[3][3] = { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } };
+
+static float dot(const float *a, const float *b) {
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+/* out = a x b.  out must be a different vector than a and b. */
+static void cross(float *out, const float *a, const float *b) {
+	out[0] = a[1] * b[2] - a[2] * b[1];
+	out[1] = a[2] * b[0] - a[0] * b[2];
+	out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+/* out = v turned angle degrees about the x, y or z axis, the same way
+ * m_rotate turns it.  out may be v. */
+static void turn(float *out, const float *v, int about, float angle) {
+	float c = cos(angle * M_PI / 180.0);
+	float s = sin(angle * M_PI / 180.0);
+	int i = (about + 1) % 3;
+	int j = (about + 2) % 3;
+	float vi = v[i], vj = v[j];
+
+	out[about] = v[about];
+	out[i] = vi * c - vj * s;
+	out[j] = vi * s + vj * c;
+}
+
+/* out = v with its part along the unit axis n taken out */
+static void flatten(float *out, const float *v, const float *n) {
+	float d = dot(v, n);
+	int i;
+
+	for ( i = 0; i < 3; i++ )
+		out[i] = v[i] - n[i] * d;
+}
+
+/* the angle, in degrees, that turns a to b about the unit axis n, once 
+ * both are flattened on to the plane n is normal to */
+static float angle_about(const float *a, const float *b, const float *n) {
+	float fa[3], fb[3], c[3];
+
+	flatten(fa, a, n);
+	flatten(fb, b, n);
+	cross(c, fa, fb);
+	return atan2(dot(c, n), dot(fa, fb)) * 180.0 / M_PI;
+}
+
+/* the two angles, in degrees, with a * cos(x) + b * sin(x) = k; when there
+ * are none, the two that come nearest */
+static void solve_trig(float a, float b, float k, float *x) {
+	float r = hypot(a, b);
+	float phi, d;
+
+	if ( r < 1e-6 ) {
+		x[0] = x[1] = 0;
+		return;
+	}
+	k /= r;
+	if ( k > 1 )
+		k = 1;
+	if ( k < -1 )
+		k = -1;
+	phi = atan2(b, a);
+	d = acos(k);
+	x[0] = remainder((phi + d) * 180.0 / M_PI, 360);
+	x[1] = remainder((phi - d) * 180.0 / M_PI, 360);
+}
+
+/* angle, kept in the limits of the angle turn t is */
+static float clamp_turn(const ik_turn *t, float angle) {
+	float min, max;
+
+	joint_limits(t->joint, t->angle, &min, &max);
+	if ( angle > max )
+		return max;
+	if ( angle < min )
+		return min;
+	return angle;
+}
+
+/* where the end of chain is from its root's pivot, in the root's base 
+ * frame, with the limb turned by a */
+static void chain_end(const ik_chain *c, const float *a, float *end) {
+	int i;
+
+	turn(end, c->lower, c->turn[2].about, a[2]);
+	for ( i = 0; i < 3; i++ )
+		end[i] += c->upper[i];
+	turn(end, end, c->turn[1].about, a[1]);
+	turn(end, end, c->turn[0].about, a[0]);
+}
+
+static float distance(const float *a, const float *b) {
+	float d[3] = { a[0] - b[0], a[1] - b[1], a[2] - b[2] };
+	return sqrt(dot(d, d));
+}
+
+/* turns the limb's hinge so the end is as far from the pivot as t is, 
+ * then the root so the end points at t; each way round that works, kept
+ * in the limits.  Leaves the nearest of those and now in a, and returns
+ * how near it is. */
+static float two_bone(const ik_chain *c, const float *t, const float *now,
+		float *a) {
+	const float *n = axes[c->turn[2].about];
+	const float *n1 = axes[c->turn[0].about];
+	const float *n2 = axes[c->turn[1].about];
+	float flat[3], side[3], v[3], w[3], aim[3], end[3], try[3];
+	float hinge[2], root[2];
+	float k, scale, err, change;
+	float best, best_change = 0;
+	int h, r, i;
+
+	/* staying put is one way, so the limits never leave it worse off */
+	for ( i = 0; i < 3; i++ )
+		a[i] = now[i];
+	chain_end(c, a, end);
+	best = distance(end, t);
+
+	/* |upper + lower turned by x|^2 = |t|^2 */
+	flatten(flat, c->lower, n);
+	cross(side, n, c->lower);
+	k = (dot(t, t) - dot(c->upper, c->upper) - 
+		dot(c->lower, c->lower)) / 2 - 
+		dot(c->upper, c->lower) + dot(c->upper, flat);
+	solve_trig(dot(c->upper, flat), dot(c->upper, side), k, hinge);
+
+	for ( h = 0; h < 2; h++ ) {
+		try[2] = clamp_turn(&c->turn[2], hinge[h]);
+		turn(v, c->lower, c->turn[2].about, try[2]);
+		for ( i = 0; i < 3; i++ )
+			v[i] += c->upper[i];
+
+		/* aim at t, or at the point on the way to it the limb 
+		 * reaches to when it can't get there */
+		scale = sqrt(dot(t, t));
+		scale = scale > 1e-6 ? sqrt(dot(v, v)) / scale : 0;
+		for ( i = 0; i < 3; i++ )
+			aim[i] = t[i] * scale;
+
+		/* the second turn puts v as far along n1 as aim is, then
+		 * the first turns it round n1 to aim */
+		flatten(flat, v, n2);
+		cross(side, n2, v);
+		solve_trig(dot(n1, flat), dot(n1, side), 
+			dot(n1, aim) - dot(n1, v) + dot(n1, flat), root);
+		for ( r = 0; r < 2; r++ ) {
+			try[1] = clamp_turn(&c->turn[1], root[r]);
+			turn(w, v, c->turn[1].about, try[1]);
+			try[0] = clamp_turn(&c->turn[0], 
+				angle_about(w, aim, n1));
+
+			chain_end(c, try, end);
+			err = distance(end, t);
+			change = fabs(try[0] - now[0]) + 
+				fabs(try[1] - now[1]) + fabs(try[2] - now[2]);
+			/* of the ways that get as near, the one that moves 
+			 * the least */
+			if ( err < best - IK_TOLERANCE || 
+					(err < best + IK_TOLERANCE && 
+					change < best_change) ) {
+				best = err;
+				best_change = change;
+				for ( i = 0; i < 3; i++ )
+					a[i] = try[i];
+			}
+		}
+	}
+	return best;
+}
+
+/* turns each of the limb's angles in turn, from the hinge back to the 
+ * root, as far towards t as its limits let it.  Returns how near the end
+ * got. */
+static float ccd(const ik_chain *c, const float *t, float *a) {
+	float o[3], axis[3], end[3], from[3], to[3];
+	float err;
+	int round, j, i;
+
+	chain_end(c, a, end);
+	err = distance(end, t);
+	for ( round = 0; round < IK_ROUNDS && err > IK_TOLERANCE; round++ ) {
+		for ( j = 2; j >= 0; j-- ) {
+			/* where angle j turns, and about what, as the limb
+			 * is now */
+			if ( j == 2 ) {
+				turn(o, c->upper, c->turn[1].about, a[1]);
+				turn(o, o, c->turn[0].about, a[0]);
+				turn(axis, axes[c->turn[2].about], 
+					c->turn[1].about, a[1]);
+				turn(axis, axis, c->turn[0].about, a[0]);
+			} else if ( j == 1 ) {
+				o[0] = o[1] = o[2] = 0;
+				turn(axis, axes[c->turn[1].about],
+					c->turn[0].about, a[0]);
+			} else {
+				o[0] = o[1] = o[2] = 0;
+				for ( i = 0; i < 3; i++ )
+					axis[i] = axes[c->turn[0].about][i];
+			}
+			for ( i = 0; i < 3; i++ ) {
+				from[i] = end[i] - o[i];
+				to[i] = t[i] - o[i];
+			}
+			a[j] = clamp_turn(&c->turn[j], 
+				a[j] + angle_about(from, to, axis));
+			chain_end(c, a, end);
+		}
+		err = distance(end, t);
+	}
+	return err;
+}
+
+/* Turns limb in pose so its end is as near target as the limits let it
+ * get, and returns how near that is.  base is the limb root's base 
+ * matrix (joint_base for the current pose), and target is in the same 
+ * space as it.  Only the limb's angles in pose are changed. */
+float ik_solve(joint_pose *pose, enum ik_limb limb, const float *base,
+		const float *target) {
+	const ik_chain *c = &chains[limb];
+	float r[3], t[3], now[3], a[3];
+	float err;
+	int i;
+
+	/* the target in the root's base frame, from its pivot.  base only
+	 * ever turns and moves, so it is undone with its transpose. */
+	for ( i = 0; i < 3; i++ )
+		r[i] = target[i] - base[12 + i];
+	for ( i = 0; i < 3; i++ )
+		t[i] = dot(base + i * 4, r) - c->pivot[i];
+
+	for ( i = 0; i < 3; i++ )
+		now[i] = pose->rot[c->turn[i].angle][c->turn[i].joint];
+	err = two_bone(c, t, now, a);
+	if ( err > IK_TOLERANCE )
+		err = ccd(c, t, a);
+
+	for ( i = 0; i < 3; i++ )
+		pose->rot[c->turn[i].angle][c->turn[i].joint] = a[i];
+	return err;
+}
+
+/* ik_solve on pose, from where the last kinematics_think left the 
+ * limb's root.  target is relative to the robot, like the joint 
+ * matrices. */
+float ik_reach(joint_pose *pose, enum ik_limb limb, const float *target) {
+	return ik_solve(pose, limb, joint_base(chains[limb].turn[0].joint), 
+		target);
+}
+
+/* where the end of limb is with pose's angles: the wrist or the ankle, 
+ * in the same space as base */
+void ik_end(const joint_pose *pose, enum ik_limb limb, const float *base,
+		float *end) {
+	const ik_chain *c = &chains[limb];
+	float a[3], e[3];
+	int i;
+
+	for ( i = 0; i < 3; i++ )
+		a[i] = pose->rot[c->turn[i].angle][c->turn[i].joint];
+	chain_end(c, a, e);
+	for ( i = 0; i < 3; i++ )
+		e[i] += c->pivot[i];
+	for ( i = 0; i < 3; i++ )
+		end[i] = base[12 + i] + base[i] * e[0] + base[4 + i] * e[1] + 
+			base[8 + i] * e[2];
+}
@@ -0,0 +1,52 @@
+/************************************************************************** 
+ * Nanobot:  A simple, interactive robot rendered using OpenGL
+ * Copyright (C) 2007, Corey Edmunds (corey.edmunds@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *************************************************************************/
+
+
+/**************************************************************************
+ * ik.c/h
+ *
+ * Inverse kinematics for the arms and legs: works out the angles that 
+ * put the end of a limb (the wrist, or the ankle) on a target.  Each 
+ * limb is a two-axis joint at the shoulder or hip and a hinge at the 
+ * elbow or knee, so it is solved with a two-bone solution first; when
+ * the joint limits stop that reaching, a few rounds of cyclic coordinate
+ * descent (CCD) get as close as the limits allow.
+ *
+ * Nothing here keeps any state, and the work per limb is fixed, so it
+ * can be run on any number of poses every tick.
+ *************************************************************************/
+#ifndef __IK_H
+#define __IK_H
+#include "joint.h"
+
+/* the limbs that can be solved */
+enum ik_limb {
+	IK_L_ARM,
+	IK_R_ARM,
+	IK_L_LEG,
+	IK_R_LEG,
+	IK_LIMBS
+};
+
+float ik_solve(joint_pose *pose, enum ik_limb limb, const float *base,
+	const float *target);
+float ik_reach(joint_pose *pose, enum ik_limb limb, const float *target);
+void ik_end(const joint_pose *pose, enum ik_limb limb, const float *base,
+	float *end);
+#endif
@@ -28,6 +28,9 @@
 #include <string.h>
 #include <math.h>
 #include <limits.h>
+#ifdef __SSE2__
+	#include <emmintrin.h>
+#endif
 
 /* nanobot's initial constraints and angles */ 
 const joint_info joints_base[JOINTCOUNT] = {
@@ -309,145 +312,207 @@ const joint_info joints_base[JOINTCOUNT] = {
 	}
 };
 
-/* the current joint configuration */
-joint_info joints[JOINTCOUNT];
+/* the current angles (hot), and each angle's limits and which joints are
+ * selected (cold) */
+joint_pose joint_angles;
+static joint_pose joint_min;
+static joint_pose joint_max;
+static int selected[JOINTCOUNT];
+
+/* an axis name ('x', 'y' or 'z') as a joint_axis, or -1 */
+static int joint_axis(int axis) {
+	if ( axis >= 'x' && axis <= 'z' )
+		return axis - 'x';
+	return -1;
+}
 
 /* initializes the joints */
 void init_joints() {
-	memcpy(joints, joints_base, sizeof(joints));
+	int j;
+
+	joint_base_pose(&joint_angles);
+	memset(&joint_min, 0, sizeof(joint_min));
+	memset(&joint_max, 0, sizeof(joint_max));
+	for ( j = 0; j < JOINTCOUNT; j++ ) {
+		joint_min.rot[AXIS_X][j] = joints_base[j].xr_min;
+		joint_max.rot[AXIS_X][j] = joints_base[j].xr_max;
+		joint_min.rot[AXIS_Y][j] = joints_base[j].yr_min;
+		joint_max.rot[AXIS_Y][j] = joints_base[j].yr_max;
+		joint_min.rot[AXIS_Z][j] = joints_base[j].zr_min;
+		joint_max.rot[AXIS_Z][j] = joints_base[j].zr_max;
+		selected[j] = joints_base[j].selected;
+	}
+}
+
+/* fills pose with the angles the joints start at */
+void joint_base_pose(joint_pose *pose) {
+	int j;
+
+	memset(pose, 0, sizeof(*pose));
+	for ( j = 0; j < JOINTCOUNT; j++ ) {
+		pose->rot[AXIS_X][j] = joints_base[j].xrot;
+		pose->rot[AXIS_Y][j] = joints_base[j].yrot;
+		pose->rot[AXIS_Z][j] = joints_base[j].zrot;
+	}
+}
+
+/* sets mask to every angle of every joint, leaving the padding slots past
+ * JOINTCOUNT off */
+void joint_movable(joint_mask *mask) {
+	int a, j;
+
+	memset(mask, 0, sizeof(*mask));
+	for ( a = 0; a < JOINT_AXES; a++ )
+		for ( j = 0; j < JOINTCOUNT; j++ )
+			mask->on[a][j] = ~0u;
 }
 
 /* selects all joints */
 void joint_select_all() {
-	unsigned int i;
+	int i;
 	
-	for ( i = 0; i < sizeof(joints)/sizeof(joint_info); i++) {
-		joints[i].selected = 1;
+	for ( i = 0; i < JOINTCOUNT; i++) {
+		selected[i] = 1;
 	}
 }
 
 /* deselects all joints */
 void joint_select_none() {
-	unsigned int i;
+	int i;
 	
-	for ( i = 0; i < sizeof(joints)/sizeof(joint_info); i++) {
-		joints[i].selected = 0;
+	for ( i = 0; i < JOINTCOUNT; i++) {
+		selected[i] = 0;
 	}
 }
 
-/* Used to get a joint's rotation about an axis (with macro mumbo jumbo) */
+/* Used to get a joint's rotation about an axis.  X_ROT and friends read
+ * the angles directly. */
 float joint_rotation(int axis, enum joint_label joint) {
-	if ( joint >= JOINTCOUNT)
+	axis = joint_axis(axis);
+	if ( joint >= JOINTCOUNT || axis < 0 )
 		return 0;
-	if ( axis == 'y' )	
-		return joints[joint].yrot;
-	if ( axis == 'x' )
-		return joints[joint].xrot;
-	if ( axis == 'z' )
-		return joints[joint].zrot;
-	return 0;
+	return joint_angles.rot[axis][joint];
+}
+
+/* the range joint's angle about axis is kept in */
+void joint_limits(enum joint_label joint, enum joint_axis axis, float *min,
+		float *max) {
+	*min = joint_min.rot[axis][joint];
+	*max = joint_max.rot[axis][joint];
 }
 
 /* Used to rotate a joint with the keyboard */
 void joint_rotate(int axis, enum joint_label joint, int rotation) {
-	if ( joint >= JOINTCOUNT)
+	float *rot;
+
+	axis = joint_axis(axis);
+	if ( joint >= JOINTCOUNT || axis < 0 )
 		return;
-	if ( axis == 'y' ) {
-		joints[joint].yrot += rotation;
-		joints[joint].yrot = fmod(joints[joint].yrot, 360);
-	} else if ( axis == 'x' ) {
-		joints[joint].xrot += rotation;
-		joints[joint].xrot = fmod(joints[joint].xrot, 360);
-	} else if ( axis == 'z' ) {
-		joints[joint].zrot += rotation;
-		joints[joint].zrot = fmod(joints[joint].zrot, 360);
-	}
-	return;
+	rot = &joint_angles.rot[axis][joint];
+	*rot += rotation;
+	*rot = fmod(*rot, 360);
 }
 
-/* Used by animation to smoothly place a joint in to position */
-int joint_xs_place(enum joint_label j, float s, float x) {
-	float o = joints[j].xrot;
+/* moves an angle s towards target and keeps it in [min, max].  Returns 
+ * whether it moved. */
+static int joint_axis_place(float *rot, float min, float max, float s, 
+		float target) {
+	float o = *rot;
 	
-	if ( fabs(joints[j].xrot - x) > s ) 
-		joints[j].xrot -= s * SIGN(joints[j].xrot - x);
+	if ( fabs(*rot - target) > s ) 
+		*rot -= s * SIGN(*rot - target);
 	else 
-		joints[j].xrot = x;
-
+		*rot = target;
 	
-	if ( joints[j].xrot > joints[j].xr_max )
-		joints[j].xrot = joints[j].xr_max;
-	if ( joints[j].xrot < joints[j].xr_min )
-		joints[j].xrot = joints[j].xr_min;
-		
-	return o != joints[j].xrot;
+	if ( *rot > max )
+		*rot = max;
+	if ( *rot < min )
+		*rot = min;
+	return o != *rot;
 }
 
 /* Used by animation to smoothly place a joint in to position */
-int joint_ys_place(enum joint_label j, float s, float y) {
-	float o = joints[j].yrot;
+int joint_s_place(enum joint_label j, float s, float x, float y, float z) {
+	const float target[JOINT_AXES] = { x, y, z };
+	int changed = 0;
+	int a;
 	
-	if ( fabs(joints[j].yrot - y) > s ) 
-		joints[j].yrot -= s * SIGN(joints[j].yrot - y);
-	else 
-		joints[j].yrot = y;
+	for ( a = 0; a < JOINT_AXES; a++ )
+		changed |= joint_axis_place(&joint_angles.rot[a][j], 
+			joint_min.rot[a][j], joint_max.rot[a][j], s, target[a]);
 	
-	if ( joints[j].yrot > joints[j].yr_max )
-		joints[j].yrot = joints[j].yr_max;
-	if ( joints[j].yrot < joints[j].yr_min )
-		joints[j].yrot = joints[j].yr_min;
-		
-	return o != joints[j].yrot;
+	return changed;
 }
 
-/* Used by animation to smoothly place a joint in to position */
-int joint_zs_place(enum joint_label j, float s, float z) {
-	float o = joints[j].zrot; 
-	
-	if ( fabs(joints[j].zrot - z) > s ) 
-		joints[j].zrot -= s * SIGN(joints[j].zrot - z);
-	else 
-		joints[j].zrot = z;
-	
-	if ( joints[j].zrot < joints[j].zr_min )
-		joints[j].zrot = joints[j].zr_min;
-	if ( joints[j].zrot > joints[j].zr_max )
-		joints[j].zrot = joints[j].zr_max;
-	return o != joints[j].zrot;
-}
+/* moves every angle of pose that mask has on towards target, by its own
+ * step in speed, and keeps it in its joint's limits; the same as 
+ * joint_s_place on each joint, in one pass over all of them.  Returns 
+ * whether any moved. */
+int joint_pose_step(joint_pose *pose, const joint_pose *target, 
+		const joint_mask *mask, const joint_pose *speed) {
+	float *rot = pose->rot[0];
+	const float *s = speed->rot[0];
+	const float *to = target->rot[0];
+	const float *min = joint_min.rot[0];
+	const float *max = joint_max.rot[0];
+	const uint32_t *on = mask->on[0];
+	int changed = 0;
+	int i = 0;
 
+#ifdef __SSE2__
+	const __m128 sign = _mm_set1_ps(-0.0f);
+	__m128 moved = _mm_setzero_ps();
 
-/* Used by animation to smoothly place a joint in to position */
-int joint_s_place(enum joint_label j, float s, float x, float y, float z) {
-	int changed = 0;
-	
-	changed |= joint_xs_place(j, s, x);
-	changed |= joint_ys_place(j, s, y);
-	changed |= joint_zs_place(j, s, z);
-	
+	for ( ; i + 4 <= JOINT_AXES * JOINT_SLOTS; i += 4 ) {
+		__m128 r = _mm_loadu_ps(rot + i);
+		__m128 t = _mm_loadu_ps(to + i);
+		__m128 use = _mm_loadu_ps((const float*)(on + i));
+		__m128 step = _mm_loadu_ps(s + i);
+		__m128 d = _mm_sub_ps(r, t);
+		__m128 far = _mm_cmpgt_ps(_mm_andnot_ps(sign, d), step);
+		/* r - s * SIGN(d), or the target if it is within a step */
+		__m128 n = _mm_sub_ps(r, _mm_or_ps(step, _mm_and_ps(sign, d)));
+
+		n = _mm_or_ps(_mm_and_ps(far, n), _mm_andnot_ps(far, t));
+		n = _mm_max_ps(_mm_min_ps(n, _mm_loadu_ps(max + i)), 
+			_mm_loadu_ps(min + i));
+		n = _mm_or_ps(_mm_and_ps(use, n), _mm_andnot_ps(use, r));
+		moved = _mm_or_ps(moved, _mm_cmpneq_ps(n, r));
+		_mm_storeu_ps(rot + i, n);
+	}
+	changed = _mm_movemask_ps(moved) != 0;
+#endif
+	for ( ; i < JOINT_AXES * JOINT_SLOTS; i++ )
+		if ( on[i] )
+			changed |= joint_axis_place(rot + i, min[i], max[i], 
+				s[i], to[i]);
 	return changed;
 }
 
 /* Used for mouse manipulation of all the selected joints */
 void joint_move(int x, int y) {
-	unsigned int i;
+	float *xrot, *yrot;
+	int i;
 	
-	for ( i = 0; i < sizeof(joints)/sizeof(joint_info); i++) {
-		if ( joints[i].selected ) {
-			joints[i].xrot += x;
-			joints[i].yrot += y;
-			if ( joints[i].xrot > joints[i].xr_max )
-				joints[i].xrot = joints[i].xr_max;
-			if ( joints[i].xrot < joints[i].xr_min )
-				joints[i].xrot = joints[i].xr_min;
-			if ( joints[i].yrot > joints[i].yr_max )
-				joints[i].yrot = joints[i].yr_max;
-			if ( joints[i].yrot < joints[i].yr_min )
-				joints[i].yrot = joints[i].yr_min;
+	for ( i = 0; i < JOINTCOUNT; i++) {
+		if ( selected[i] ) {
+			xrot = &joint_angles.rot[AXIS_X][i];
+			yrot = &joint_angles.rot[AXIS_Y][i];
+			*xrot += x;
+			*yrot += y;
+			if ( *xrot > joint_max.rot[AXIS_X][i] )
+				*xrot = joint_max.rot[AXIS_X][i];
+			if ( *xrot < joint_min.rot[AXIS_X][i] )
+				*xrot = joint_min.rot[AXIS_X][i];
+			if ( *yrot > joint_max.rot[AXIS_Y][i] )
+				*yrot = joint_max.rot[AXIS_Y][i];
+			if ( *yrot < joint_min.rot[AXIS_Y][i] )
+				*yrot = joint_min.rot[AXIS_Y][i];
 			/* make them roll at 360 degrees */
-			joints[i].xrot = fmod(joints[i].xrot, 360);
-			joints[i].yrot = fmod(joints[i].yrot, 360);
-			joints[i].zrot = fmod(joints[i].zrot, 360);
+			*xrot = fmod(*xrot, 360);
+			*yrot = fmod(*yrot, 360);
+			joint_angles.rot[AXIS_Z][i] = 
+				fmod(joint_angles.rot[AXIS_Z][i], 360);
 		}
 	}
 }
@@ -456,7 +521,7 @@ void joint_move(int x, int y) {
 int joint_selected_(enum joint_label joint) {
 	if ( joint >= JOINTCOUNT)
 		return 0;
-	return joints[joint].selected;
+	return selected[joint];
 }
 
 /* Used to select a joint on mouse click */
@@ -464,5 +529,52 @@ void joint_pick(enum joint_label joint) {
 	if ( joint >= JOINTCOUNT)
 		return;
 	
-	joints[joint].selected = !joints[joint].selected;
+	selected[joint] = !selected[joint];
+}
+
+/* writes the joints' angles and which are selected to a snapshot */
+void joints_save(snapshot_writer *w) {
+	snapshot_begin(w, SNAP_JOINTS);
+	snapshot_write(w, &joint_angles, sizeof(joint_angles));
+	snapshot_write(w, selected, sizeof(selected));
+	snapshot_end(w);
+}
+
+/* finds the joints in a snapshot.  Returns 0 if they are missing or 
+ * any angle is not a number. */
+static int joints_find(const snapshot_t *s, const joint_pose **angles,
+		const int **picked) {
+	snapshot_reader r;
+	int c;
+
+	if ( !snapshot_find(s, SNAP_JOINTS, &r) )
+		return 0;
+	*angles = snapshot_read(&r, sizeof(joint_angles));
+	*picked = snapshot_read(&r, sizeof(selected));
+	if ( !*angles || !*picked )
+		return 0;
+	for ( c = 0; c < JOINT_AXES * JOINT_SLOTS; c++ )
+		if ( !isfinite((*angles)->rot[0][c]) )
+			return 0;
+	return 1;
+}
+
+/* checks the snapshot's joints can be restored, without restoring them */
+int joints_check(const snapshot_t *s) {
+	const joint_pose *angles;
+	const int *picked;
+
+	return joints_find(s, &angles, &picked);
+}
+
+/* restores the joints from a snapshot.  Returns 0 if it has none. */
+int joints_restore(const snapshot_t *s) {
+	const joint_pose *angles;
+	const int *picked;
+
+	if ( !joints_find(s, &angles, &picked) )
+		return 0;
+	memcpy(&joint_angles, angles, sizeof(joint_angles));
+	memcpy(selected, picked, sizeof(selected));
+	return 1;
 }
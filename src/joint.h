@@ -26,6 +26,8 @@
  *************************************************************************/
 #ifndef __JOINT_H
 #define __JOINT_H
+#include <stdint.h>
+#include "snapshot.h"
 
 #define JOINTCOUNT 23
 /* the joint-parts */
@@ -57,7 +59,7 @@ enum joint_label {
 	SL_R_TOES
 };
 
-/* the joint-configuration (angles and limits) */
+/* the joint-configuration (angles and limits), as the joints start */
 typedef struct {
 	float xrot, xr_min, xr_max;
 	float yrot, yr_min, yr_max;
@@ -66,24 +68,57 @@ typedef struct {
 	int selected;
 } joint_info;
 
+/* the axes a joint turns about */
+enum joint_axis {
+	AXIS_X,
+	AXIS_Y,
+	AXIS_Z,
+	JOINT_AXES
+};
+
+/* JOINTCOUNT rounded up to a whole number of vectors */
+#define JOINT_SLOTS 24
+
+/* every joint's angles: an array per axis, so all of them can be worked
+ * on a vector at a time.  The slots past JOINTCOUNT are kept at 0. */
+typedef struct {
+	float rot[JOINT_AXES][JOINT_SLOTS];
+} joint_pose;
+
+/* which of a pose's angles to work on: all bits set for yes, clear for 
+ * no, as a vector compare gives them */
+typedef struct {
+	uint32_t on[JOINT_AXES][JOINT_SLOTS];
+} joint_mask;
+
+/* the current angles.  The limits are kept apart in joint.c, as only 
+ * the solver reads them. */
+extern joint_pose joint_angles;
+
 void pick_joint(enum joint_label joint);
 int joint_selected_(enum joint_label joint);
 float joint_rotation(int axis, enum joint_label joint);
+void joint_limits(enum joint_label joint, enum joint_axis axis, float *min,
+	float *max);
 void joint_select_all(void);
 void joint_select_none(void);
 void init_joints(void);
+void joint_base_pose(joint_pose *pose);
+void joint_movable(joint_mask *mask);
 void joint_pick(enum joint_label joint);
 void joint_move(int x, int y);
 void joint_rotate(int axis, enum joint_label joint, int rotation);
-int joint_xs_place(enum joint_label j, float s, float x);
-int joint_ys_place(enum joint_label j, float s, float y);
-int joint_zs_place(enum joint_label j, float s, float z);
 int joint_s_place(enum joint_label j, float s, float x, float y, float z);
+int joint_pose_step(joint_pose *pose, const joint_pose *target, 
+	const joint_mask *mask, const joint_pose *speed);
+void joints_save(snapshot_writer *w);
+int joints_check(const snapshot_t *s);
+int joints_restore(const snapshot_t *s);
 
 /*#define joint_selected(j) (joints[j].selected)*/
 #define joint_selected(j) joint_selected_(j)
 #define SELECTED(j) if(joint_selected(j))
-#define Y_ROT(j) (joint_rotation('y', j))
-#define X_ROT(j) (joint_rotation('x', j))
-#define Z_ROT(j) (joint_rotation('z', j))
+#define Y_ROT(j) (joint_angles.rot[AXIS_Y][j])
+#define X_ROT(j) (joint_angles.rot[AXIS_X][j])
+#define Z_ROT(j) (joint_angles.rot[AXIS_Z][j])
 #endif
@@ -0,0 +1,327 @@
+/************************************************************************** 
+ * Nanobot:  A simple, interactive robot rendered using OpenGL
+ * Copyright (C) 2007, Corey Edmunds (corey.edmunds@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *************************************************************************/
+
+
+/**************************************************************************
+ * kinematics.c/h
+ *
+ * Works out where every joint is, on the CPU, once per tick.  Each 
+ * joint has a fixed offset from its parent (where it is mounted) and 
+ * turns by its own angles from there.  Its local matrix is the two 
+ * together, and its matrix is its parent's matrix times its local one:
+ * the modelview its part is drawn with, relative to the robot (ie. 
+ * without the look-at).  render.c draws from these matrices, and 
+ * anything else that wants to follow a part reads them here instead of
+ * asking GL.
+ *
+ * Only the joints whose angles have changed since the last tick, and 
+ * the joints below them, are worked out again.
+ *************************************************************************/
+#include <string.h>
+#include "kinematics.h"
+#include "matrix.h"
+
+static void joint_offset(float *m, enum joint_label joint);
+static void joint_turn(float *m, enum joint_label joint, const float *a);
+
+/* each joint's parent, -1 for the body.  Every parent comes before its
+ * children, so one pass in order sees each parent first. */
+static const int parents[JOINTCOUNT] = {
+	-1,			/* SL_BODY */
+	SL_BODY,		/* SL_L_THRUSTER */
+	SL_BODY,		/* SL_R_THRUSTER */
+	SL_BODY,		/* SL_HEADLIGHTS */
+	SL_BODY,		/* SL_CAMERA */
+	SL_BODY,		/* SL_L_SOLARPANEL */
+	SL_BODY,		/* SL_R_SOLARPANEL */
+	SL_BODY,		/* SL_L_UPPERARM */
+	SL_BODY,		/* SL_R_UPPERARM */
+	SL_L_UPPERARM,		/* SL_L_FOREARM */
+	SL_R_UPPERARM,		/* SL_R_FOREARM */
+	SL_L_FOREARM,		/* SL_L_WRIST */
+	SL_R_FOREARM,		/* SL_R_WRIST */
+	SL_L_WRIST,		/* SL_L_FINGERS */
+	SL_R_WRIST,		/* SL_R_FINGERS */
+	SL_BODY,		/* SL_L_UPPERLEG */
+	SL_BODY,		/* SL_R_UPPERLEG */
+	SL_L_UPPERLEG,		/* SL_L_LOWERLEG */
+	SL_R_UPPERLEG,		/* SL_R_LOWERLEG */
+	SL_L_LOWERLEG,		/* SL_L_FOOT */
+	SL_R_LOWERLEG,		/* SL_R_FOOT */
+	SL_L_FOOT,		/* SL_L_TOES */
+	SL_R_FOOT		/* SL_R_TOES */
+};
+
+/* each joint's offset from its parent, the same for every pose */
+static float offsets[JOINTCOUNT][16];
+static int offsets_ready = 0;
+
+/* each joint's local matrix, base (its parent's matrix times its offset:
+ * where it turns) and matrix, and the angles they were worked out from.
+ * There are two: the robot as the last tick left it, which everything
+ * but the drawing follows, and the robot as it was last drawn. */
+struct kinematics {
+	float locals[JOINTCOUNT][16];
+	float bases[JOINTCOUNT][16];
+	float matrixes[JOINTCOUNT][16];
+	float angles[JOINTCOUNT][3];
+	int ready;
+};
+static struct kinematics ticked, drawn;
+
+/* m = m * where joint is mounted on its parent.  The translations along
+ * the arms and legs are the ones the parent's display lists leave 
+ * behind. */
+static void joint_offset(float *m, enum joint_label joint) {
+	switch ( joint ) {
+		case SL_BODY:
+			break;
+		/* out along the pylons */
+		case SL_L_THRUSTER:
+		case SL_R_THRUSTER:
+			m_rotate(m, joint == SL_L_THRUSTER ? 90 : -90, 0, 1, 0);
+			m_rotate(m, -40, 1, 0, 0);
+			m_translate(m, 0, 0, 0.90);
+			m_rotate(m, 10, 1, 0, 0);
+			m_translate(m, 0, 0, 0.55);
+			break;
+		case SL_HEADLIGHTS:
+			m_translate(m, 0, 0.75, 0.50);
+			break;
+		case SL_CAMERA:
+			m_rotate(m, -25, 1, 0, 0);
+			m_translate(m, 0, 0, 1);
+			break;
+		case SL_L_SOLARPANEL:
+			m_translate(m, 0.2, 0.75, -0.30);
+			m_rotate(m, 90, 0, 1, 0);
+			break;
+		case SL_R_SOLARPANEL:
+			m_translate(m, 0.2 - 0.4, 0.75, -0.30);
+			m_rotate(m, -90, 0, 1, 0);
+			break;
+		case SL_L_UPPERARM:
+		case SL_R_UPPERARM:
+			m_rotate(m, joint == SL_L_UPPERARM ? 90 : -90, 0, 1, 0);
+			m_translate(m, 0, 0, 1.0);
+			break;
+		case SL_L_FOREARM:
+		case SL_R_FOREARM:
+			m_translate(m, 0.005, 0, 0.525);
+			break;
+		case SL_L_WRIST:
+		case SL_R_WRIST:
+			m_translate(m, 0, 0, 0.46);
+			break;
+		case SL_L_FINGERS:
+		case SL_R_FINGERS:
+			m_translate(m, 0, 0, 0.08);
+			break;
+		case SL_L_UPPERLEG:
+			m_rotate(m, -180+50, 0, 0, 1);
+			m_translate(m, 1.0, 0, 0);
+			m_rotate(m, 180-50, 0, 0, 1);
+			break;
+		case SL_R_UPPERLEG:
+			m_rotate(m, -50, 0, 0, 1);
+			m_translate(m, 1.0, 0, 0);
+			m_rotate(m, 50, 0, 0, 1);
+			break;
+		/* the knee.  The left upper leg is drawn turned round, so its
+		 * display list leaves it at z 0.135, but render.c draws 
+		 * each part from its own matrix so that doesn't matter. */
+		case SL_L_LOWERLEG:
+		case SL_R_LOWERLEG:
+			m_translate(m, 0, -0.01, -0.135);
+			break;
+		case SL_L_FOOT:
+		case SL_R_FOOT:
+			m_translate(m, 0, -0.292, 0.135);
+			break;
+		/* the toes pivot here; each toe turns on its own from it */
+		case SL_L_TOES:
+		case SL_R_TOES:
+			m_translate(m, 0, -0.065, 0);
+			break;
+	}
+}
+
+/* m = m * joint's own turn by its angles, a */
+static void joint_turn(float *m, enum joint_label joint, const float *a) {
+	switch ( joint ) {
+		case SL_BODY:
+			m_rotate(m, a[AXIS_X], 0, 1, 0);
+			m_rotate(m, a[AXIS_Y], 1, 0, 0);
+			m_rotate(m, a[AXIS_Z], 0, 0, 1);
+			break;
+		/* turned so the back end looks straight and it points the 
+		 * right way */
+		case SL_L_THRUSTER:
+			m_rotate(m, a[AXIS_Y], 0, 0, 1);
+			m_rotate(m, 30, 1, 0, 0);
+			m_rotate(m, 180, 0, 0, 1);
+			m_rotate(m, 90, 0, 1, 0);
+			break;
+		case SL_R_THRUSTER:
+			m_rotate(m, -a[AXIS_Y], 0, 0, 1);
+			m_rotate(m, 30, 1, 0, 0);
+			m_rotate(m, 90, 0, 1, 0);
+			break;
+		/* the left headlight, on the end of its stick; the right one
+		 * is 0.2 along x from it */
+		case SL_HEADLIGHTS:
+			m_rotate(m, a[AXIS_X], 0, 1, 0);
+			m_translate(m, 0, 0.5, 0.2);
+			m_translate(m, -0.1, 0, -0.025);
+			m_rotate(m, a[AXIS_Y], 1, 0, 0);
+			break;
+		case SL_CAMERA:
+		case SL_L_WRIST:
+		case SL_R_WRIST:
+			m_rotate(m, a[AXIS_X], 0, 1, 0);
+			m_rotate(m, a[AXIS_Y], 1, 0, 0);
+			break;
+		/* the panel, on the end of its stick */
+		case SL_L_SOLARPANEL:
+		case SL_R_SOLARPANEL:
+			m_rotate(m, a[AXIS_X], 0, 1, 0);
+			m_translate(m, 0, 0.5, 0);
+			m_rotate(m, a[AXIS_Y], 0, 0, 1);
+			break;
+		case SL_L_UPPERARM:
+		case SL_R_UPPERARM:
+			m_rotate(m, a[AXIS_Y], 0, 0, 1);
+			m_translate(m, 0, 0, 0.125);
+			m_rotate(m, a[AXIS_X], 1, 0, 0);
+			break;
+		case SL_L_FOREARM:
+		case SL_R_FOREARM:
+			m_rotate(m, a[AXIS_Y], 0, 1, 0);
+			break;
+		case SL_L_FINGERS:
+		case SL_R_FINGERS:
+			m_rotate(m, a[AXIS_X]/2, 1, 0, 0);
+			break;
+		case SL_L_UPPERLEG:
+		case SL_R_UPPERLEG:
+			m_rotate(m, a[AXIS_X], 0, 1, 0);
+			m_rotate(m, a[AXIS_Y], 1, 0, 0);
+			m_translate(m, joint == SL_L_UPPERLEG ? -0.025 : 0.025, 
+				-0.30, 0);
+			break;
+		case SL_L_LOWERLEG:
+		case SL_R_LOWERLEG:
+			m_rotate(m, a[AXIS_Y], 1, 0, 0);
+			break;
+		case SL_L_FOOT:
+		case SL_R_FOOT:
+			m_rotate(m, a[AXIS_Y], 1, 0, 0);
+			m_rotate(m, a[AXIS_X], 0, 1, 0);
+			break;
+		case SL_L_TOES:
+		case SL_R_TOES:
+			break;
+	}
+}
+
+/* works out k's matrixes for the joints that have moved since it was
+ * last worked out, and for the joints below them, from pose's angles */
+static void kinematics_update(struct kinematics *k, const joint_pose *pose) {
+	int moved[JOINTCOUNT];
+	float a[3];
+	int j, p;
+
+	if ( !offsets_ready ) {
+		for(j=0; j<JOINTCOUNT; j++) {
+			m_identity(offsets[j]);
+			joint_offset(offsets[j], j);
+		}
+		offsets_ready = 1;
+	}
+	for(j=0; j<JOINTCOUNT; j++) {
+		a[AXIS_X] = pose->rot[AXIS_X][j];
+		a[AXIS_Y] = pose->rot[AXIS_Y][j];
+		a[AXIS_Z] = pose->rot[AXIS_Z][j];
+		p = parents[j];
+		moved[j] = !k->ready || memcmp(a, k->angles[j], sizeof(a));
+		if ( moved[j] ) {
+			memcpy(k->angles[j], a, sizeof(a));
+			m_copy(k->locals[j], offsets[j]);
+			joint_turn(k->locals[j], j, a);
+		} 
+		if ( p < 0 ) {
+			if ( moved[j] ) {
+				m_copy(k->bases[j], offsets[j]);
+				m_copy(k->matrixes[j], k->locals[j]);
+			}
+		} else if ( moved[p] ) {
+			moved[j] = 1;
+			m_multiply(k->bases[j], k->matrixes[p], offsets[j]);
+			m_multiply(k->matrixes[j], k->matrixes[p], 
+				k->locals[j]);
+		} else if ( moved[j] )
+			m_multiply(k->matrixes[j], k->matrixes[p], 
+				k->locals[j]);
+	}
+	k->ready = 1;
+}
+
+/* works out the matrixes of the joints that have moved, and of the 
+ * joints below them, from the current joint angles */
+void kinematics_think(void) {
+	kinematics_update(&ticked, &joint_angles);
+}
+
+/* works out the matrixes the robot is drawn with from pose's angles: 
+ * the robot between two ticks, say.  These are kept apart from the 
+ * tick's, so drawing never changes what the next tick sees. */
+void kinematics_pose(const joint_pose *pose) {
+	kinematics_update(&drawn, pose);
+}
+
+/* the matrix joint's part is drawn with, relative to the robot, as of
+ * the last kinematics_think */
+const float *joint_matrix(enum joint_label joint) {
+	return ticked.matrixes[joint];
+}
+
+/* joint's matrix relative to its parent's: its offset and its turn */
+const float *joint_local(enum joint_label joint) {
+	return ticked.locals[joint];
+}
+
+/* where joint turns, relative to the robot: its parent's matrix and its
+ * offset, without its own angles.  Parts that are drawn before a joint 
+ * has turned (the elbow, say) are drawn from here. */
+const float *joint_base(enum joint_label joint) {
+	return ticked.bases[joint];
+}
+
+/* joint's matrix, or with base where it turns, as of the last 
+ * kinematics_pose: what render.c draws with */
+const float *joint_drawn(enum joint_label joint, int base) {
+	return base ? drawn.bases[joint] : drawn.matrixes[joint];
+}
+
+/* joint's angles, indexed by axis, as of the last kinematics_pose: for
+ * the turns render.c makes inside a part, which have to agree with the
+ * matrix it is drawn from */
+const float *joint_drawn_angles(enum joint_label joint) {
+	return drawn.angles[joint];
+}
@@ -0,0 +1,50 @@
+/************************************************************************** 
+ * Nanobot:  A simple, interactive robot rendered using OpenGL
+ * Copyright (C) 2007, Corey Edmunds (corey.edmunds@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *************************************************************************/
+
+
+/**************************************************************************
+ * kinematics.c/h
+ *
+ * Works out where every joint is, on the CPU, once per tick.  Each 
+ * joint has a fixed offset from its parent (where it is mounted) and 
+ * turns by its own angles from there.  Its local matrix is the two 
+ * together, and its matrix is its parent's matrix times its local one:
+ * the modelview its part is drawn with, relative to the robot (ie. 
+ * without the look-at).  render.c draws from these matrices, and 
+ * anything else that wants to follow a part reads them here instead of
+ * asking GL.
+ *
+ * Only the joints whose angles have changed since the last tick, and 
+ * the joints below them, are worked out again.  The robot as it is 
+ * drawn, between two ticks, is worked out into a second set of 
+ * matrices and angles (kinematics_pose, joint_drawn, 
+ * joint_drawn_angles) so the tick's are left alone.
+ *************************************************************************/
+#ifndef __KINEMATICS_H
+#define __KINEMATICS_H
+#include "joint.h"
+
+void kinematics_think(void);
+void kinematics_pose(const joint_pose *pose);
+const float *joint_matrix(enum joint_label joint);
+const float *joint_local(enum joint_label joint);
+const float *joint_base(enum joint_label joint);
+const float *joint_drawn(enum joint_label joint, int base);
+const float *joint_drawn_angles(enum joint_label joint);
+#endif
@@ -0,0 +1,138 @@
+/************************************************************************** 
+ * Nanobot:  A simple, interactive robot rendered using OpenGL
+ * Copyright (C) 2007, Corey Edmunds (corey.edmunds@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *************************************************************************/
+
+
+/**************************************************************************
+ * matrix.c/h
+ *
+ * 4x4 matrices on the CPU, stored column major like GL's.  The rotate and
+ * translate functions post-multiply, the same as glRotatef/glTranslatef, 
+ * so a chain of GL calls can be copied across line for line.
+ *************************************************************************/
+#include "matrix.h"
+#include <math.h>
+#include <string.h>
+
+/* sets m to the identity */
+void m_identity(float *m) {
+	memset(m, 0, sizeof(float) * 16);
+	m[0] = m[5] = m[10] = m[15] = 1;
+}
+
+/* copies m to out */
+void m_copy(float *out, const float *m) {
+	memcpy(out, m, sizeof(float) * 16);
+}
+
+/* out = a * b.  out may be a or b. */
+void m_multiply(float *out, const float *a, const float *b) {
+	float r[16];
+	int i, j;
+
+	for(j=0; j<4; j++)
+		for(i=0; i<4; i++)
+			r[j*4+i] = a[i] * b[j*4] + a[4+i] * b[j*4+1] + 
+				a[8+i] * b[j*4+2] + a[12+i] * b[j*4+3];
+	m_copy(out, r);
+}
+
+/* m = m * rotation of angle degrees about (x, y, z), like glRotatef.  The
+ * axes used here are always unit length. */
+void m_rotate(float *m, float angle, float x, float y, float z) {
+	float r[16];
+	float c, s, t;
+
+	if ( angle == 0 )
+		return;
+	c = cos(angle * M_PI / 180.0);
+	s = sin(angle * M_PI / 180.0);
+	t = 1 - c;
+
+	r[0] = x*x*t + c;
+	r[1] = y*x*t + z*s;
+	r[2] = x*z*t - y*s;
+	r[3] = 0;
+	r[4] = x*y*t - z*s;
+	r[5] = y*y*t + c;
+	r[6] = y*z*t + x*s;
+	r[7] = 0;
+	r[8] = x*z*t + y*s;
+	r[9] = y*z*t - x*s;
+	r[10] = z*z*t + c;
+	r[11] = 0;
+	r[12] = r[13] = r[14] = 0;
+	r[15] = 1;
+	m_multiply(m, m, r);
+}
+
+/* m = m * translation, like glTranslatef */
+void m_translate(float *m, float x, float y, float z) {
+	int i;
+
+	for(i=0; i<4; i++)
+		m[12+i] += m[i] * x + m[4+i] * y + m[8+i] * z;
+}
+
+/* m = m * the view from eye looking at center, with up upwards, like 
+ * gluLookAt */
+void m_look_at(float *m, const float *eye, const float *center, 
+		const float *up) {
+	float f[3], s[3], u[3], r[16];
+	float l;
+	int i;
+
+	for(i=0; i<3; i++)
+		f[i] = center[i] - eye[i];
+	l = sqrt(f[0]*f[0] + f[1]*f[1] + f[2]*f[2]);
+	for(i=0; i<3; i++)
+		f[i] /= l;
+	s[0] = f[1] * up[2] - f[2] * up[1];
+	s[1] = f[2] * up[0] - f[0] * up[2];
+	s[2] = f[0] * up[1] - f[1] * up[0];
+	l = sqrt(s[0]*s[0] + s[1]*s[1] + s[2]*s[2]);
+	for(i=0; i<3; i++)
+		s[i] /= l;
+	u[0] = s[1] * f[2] - s[2] * f[1];
+	u[1] = s[2] * f[0] - s[0] * f[2];
+	u[2] = s[0] * f[1] - s[1] * f[0];
+
+	m_identity(r);
+	for(i=0; i<3; i++) {
+		r[i*4] = s[i];
+		r[i*4+1] = u[i];
+		r[i*4+2] = -f[i];
+	}
+	m_multiply(m, m, r);
+	m_translate(m, -eye[0], -eye[1], -eye[2]);
+}
+
+/* transforms v by m */
+vec4f m_mult(const float *m, vec4f v) {
+	vec4f r;
+	int i;
+	int j;
+
+	for(i=0; i<4; i++) {
+		r.v[i] = 0;
+		for(j=0; j<4; j++) 
+			r.v[i] += m[j*4+i] * v.v[j];
+	}	
+
+	return r;
+}
@@ -0,0 +1,40 @@
+/************************************************************************** 
+ * Nanobot:  A simple, interactive robot rendered using OpenGL
+ * Copyright (C) 2007, Corey Edmunds (corey.edmunds@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *************************************************************************/
+
+
+/**************************************************************************
+ * matrix.c/h
+ *
+ * 4x4 matrices on the CPU, stored column major like GL's.  The rotate and
+ * translate functions post-multiply, the same as glRotatef/glTranslatef, 
+ * so a chain of GL calls can be copied across line for line.
+ *************************************************************************/
+#ifndef __MATRIX_H
+#define __MATRIX_H
+#include "vector.h"
+
+void m_identity(float *m);
+void m_copy(float *out, const float *m);
+void m_multiply(float *out, const float *a, const float *b);
+void m_rotate(float *m, float angle, float x, float y, float z);
+void m_translate(float *m, float x, float y, float z);
+void m_look_at(float *m, const float *eye, const float *center, 
+	const float *up);
+vec4f m_mult(const float *m, vec4f v);
+#endif
@@ -34,13 +34,23 @@
 #include <stdio.h>
 #include <assert.h>
 #include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 #include "materials.h"
 #include "vector.h"
 #include "draw.h"
 #include "render.h"
 #include "joint.h"
 #include "animate.h"
+#include "clip.h"
 #include "particles.h"
+#include "workers.h"
+#include "rng.h"
+#include "kinematics.h"
+#include "quality.h"
+#include "curl.h"
+#include "snapshot.h"
 
 static void reshape(int width, int height);
 static void keypress(unsigned char key, int x, int y);
@@ -48,10 +58,12 @@ static void specialkey(int key, int x, int y);
 static void init(void);
 static void render_scene(void);
 static void mouse(int button, int state, int x, int y);
-static void robot_think(int n); 
+static void robot_think(int n);
+static void robot_redraw(int n);
 static void move(int x, int y);
 static void init_menus(void);
 static void menu_click(int val);
+static void parse_args(int argc, char *argv[]);
 
 int fill = 1;
 int xwidth = 0;
@@ -61,12 +73,51 @@ static int mouse_y = 0;
 int lights_on = 1;
 static int particles_anim = 1;
 static int particles_disp = 1;
+/* the number of threads to think with, 0 for one per CPU */
+static int threads = 0;
+/* the size of the particle pool, 0 for the default */
+static int particle_count = 0;
+/* the milliseconds per tick the smoke may take, 0 for no limit */
+static double frame_budget = QUALITY_DEFAULT_BUDGET;
+/* the ticks the smoke is run on before it is shown */
+static int prewarm = PARTICLE_SETTLE_TICKS;
+/* the vector unit the smoke kernels use, SIMD_LEVELS for the best there
+ * is, and whether the smoke is lit */
+static enum simd_level simd = SIMD_LEVELS;
+static int smoke_lit = 1;
+/* the snapshot the Z and X keys save and load, and the one to start 
+ * from instead of prewarming, if any */
+static const char *snapshot = "nanobot.snap";
+static const char *resume = NULL;
+static const char *clip_dir = NULL;
+/* the Clips submenu, which recordings are added to */
+static int clip_menu;
+
+/* the animation ticks a fixed ROBOT_MS_PER_FRAME of wall-clock time, 
+ * whatever the frame rate: robot_think runs the ticks that are due and 
+ * sets its timer for the next.  robot_redraw redraws the scene, between
+ * the last two ticks, every ROBOT_MS_PER_DRAW (about 60 a second) on a 
+ * timer of its own.  A machine that can't keep up runs at most 
+ * ROBOT_MAX_TICKS at once and lets the rest go, slowing down rather 
+ * than falling ever further behind. */
+#define ROBOT_MAX_TICKS 8
+#define ROBOT_MS_PER_DRAW 16
+/* when the next tick and the next draw are due, in milliseconds, or -1
+ * before the first */
+static double tick_due = -1;
+static double draw_due = -1;
+
+/* the camera looks at the robot's middle from CAMERA_DISTANCE away, 
+ * with a CAMERA_FOV degree field of view */
+#define CAMERA_DISTANCE 4
+#define CAMERA_FOV 60
 /**************************************************************************/
 /* main: all initialization and callback registration.		          */
 /**************************************************************************/
 int main( int argc, char *argv[] )
 {
 	glutInit( &argc, argv );
+	parse_args( argc, argv );
 	glutInitWindowSize( 1024, 600 );
 	glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
 	glutCreateWindow( "Nanobot - By Corey Edmunds" );
@@ -77,6 +128,7 @@ int main( int argc, char *argv[] )
 	glutMotionFunc( move );
 	glutSpecialFunc ( specialkey );
 	glutTimerFunc ( ROBOT_MS_PER_FRAME, robot_think, 1 );
+	glutTimerFunc ( ROBOT_MS_PER_DRAW, robot_redraw, 1 );
 	init();
 
 	glutMainLoop();
@@ -84,6 +136,53 @@ int main( int argc, char *argv[] )
 	return( 0 );    /* NOTE: this is here only for ANSI requirements */
 }
 
+/**************************************************************************/
+/* parse_args:  handle the options glutInit left behind                   */
+/**************************************************************************/
+static void parse_args(int argc, char *argv[]) {
+	int i;
+
+	for ( i = 1; i < argc; i++ ) {
+		if ( !strcmp(argv[i], "--threads") && i + 1 < argc ) {
+			threads = atoi(argv[++i]);
+		} else if ( !strcmp(argv[i], "--seed") && i + 1 < argc ) {
+			rng_seed(strtoull(argv[++i], NULL, 0));
+		} else if ( !strcmp(argv[i], "--particles") && i + 1 < argc ) {
+			particle_count = atoi(argv[++i]);
+		} else if ( !strcmp(argv[i], "--frame-budget") && i + 1 < argc ) {
+			frame_budget = atof(argv[++i]);
+		} else if ( !strcmp(argv[i], "--prewarm") && i + 1 < argc ) {
+			prewarm = atoi(argv[++i]);
+		} else if ( !strcmp(argv[i], "--simd") && i + 1 < argc ) {
+			i++;
+			for(simd=0; simd<SIMD_LEVELS; simd++)
+				if ( !strcmp(argv[i], simd_name(simd)) )
+					break;
+			if ( simd == SIMD_LEVELS || !simd_supported(simd) ) {
+				printf("%s %d:  no %s kernels on this machine\n", 
+					__FILE__, __LINE__, argv[i]);
+				exit(1);
+			}
+		} else if ( !strcmp(argv[i], "--snapshot") && i + 1 < argc ) {
+			snapshot = argv[++i];
+		} else if ( !strcmp(argv[i], "--resume") && i + 1 < argc ) {
+			resume = argv[++i];
+		} else if ( !strcmp(argv[i], "--clips") && i + 1 < argc ) {
+			clip_dir = argv[++i];
+		} else if ( !strcmp(argv[i], "--lite") ) {
+			smoke_lit = 0;
+			if ( !particle_count )
+				particle_count = PARTICLE_LITE_COUNT;
+		} else {
+			printf("usage: %s [--threads n] [--seed n] [--particles n] "
+				"[--frame-budget ms] [--prewarm ticks] "
+				"[--simd c|sse2|avx] [--lite] [--snapshot file] "
+				"[--resume file] [--clips dir]\n", argv[0]);
+			exit(1);
+		}
+	}
+}
+
 /**************************************************************************/
 /* init:  initialize display modes and                                    */
 /**************************************************************************/
@@ -145,8 +244,22 @@ static void init(void) {
 	
 	init_display_lists();
 	init_joints();
+	init_animation();
+	if ( clip_dir )
+		clip_load_dir(clip_dir);
 	init_menus();
+	init_workers(threads);
+	init_curl();
 	init_particles();
+	if ( particle_count ) 
+		particles_set_capacity(particle_count);
+	if ( simd != SIMD_LEVELS )
+		particles_set_simd(simd);
+	particles_set_lit(smoke_lit);
+	init_quality(frame_budget);
+	kinematics_think();
+	if ( !resume || !snapshot_load(resume) )
+		particles_prewarm(prewarm);
 }
 
 /* handles animation submenu selections */
@@ -154,6 +267,11 @@ static void menu_animate_click(int val) {
 	animate(val);
 }
 
+/* handles clip submenu selections */
+static void menu_clip_click(int val) {
+	animate_clip(val);
+}
+
 /* handles joint submenu selections */
 static void menu_joint_click(int val) {
 	if ( val >= 0 )
@@ -166,6 +284,32 @@ static void menu_joint_click(int val) {
 	}		
 }
 
+/* stops the recording, saving it in the clips directory as the first 
+ * takeN.clip that isn't there yet, and adds it to the Clips menu */
+static void record_stop(void) {
+	const char *dir = clip_dir ? clip_dir : ".";
+	char name[CLIP_NAME];
+	char *path;
+	int n, clip;
+
+	path = malloc(strlen(dir) + CLIP_NAME + 7);
+	if ( !path )
+		return;
+	for ( n = 1; ; n++ ) {
+		snprintf(name, sizeof(name), "take%d", n);
+		sprintf(path, "%s/%s.clip", dir, name);
+		if ( access(path, F_OK) )
+			break;
+	}
+	clip = animate_record_save(name, path);
+	if ( clip >= 0 ) {
+		printf("recorded %s\n", path);
+		glutSetMenu(clip_menu);
+		glutAddMenuEntry(name, clip);
+	}
+	free(path);
+}
+
 /* Handles main menu selections */
 static void menu_click(int val) {
 	keypress(val, 0, 0);
@@ -179,6 +323,8 @@ static void menu_smoke_click(int val) {
 /* initializes the menus */
 static void init_menus() {
 	int animate_menu, joints_menu, smoke_menu;
+	char name[CLIP_NAME + 1];
+	int i;
 	
 	animate_menu = glutCreateMenu(menu_animate_click);
 	glutAddMenuEntry("Standby", ANIM_STANDBY);
@@ -186,6 +332,13 @@ static void init_menus() {
 	glutAddMenuEntry("Dance", ANIM_DANCE);
 	glutAddMenuEntry("Walk", ANIM_WALK);
 	glutAddMenuEntry("Reboot", ANIM_RESET);
+
+	clip_menu = glutCreateMenu(menu_clip_click);
+	for ( i = 0; i < clip_count(); i++ ) {
+		snprintf(name, sizeof(name), "%.*s", CLIP_NAME, 
+			clip_get(i)->head->name);
+		glutAddMenuEntry(name, i);
+	}
 	
 	joints_menu = glutCreateMenu(menu_joint_click);
 	glutAddMenuEntry("All", -1);
@@ -227,11 +380,26 @@ static void init_menus() {
 	glutCreateMenu(menu_click);
 	glutAddSubMenu("Joints", joints_menu);
 	glutAddSubMenu("Animate", animate_menu);
+	glutAddSubMenu("Clips", clip_menu);
 	glutAddSubMenu("Smoke", smoke_menu);
 	glutAddMenuEntry("Switch Light (L)", 'l');
 	glutAddMenuEntry("Freeze Smoke (F)", 'f');
 	glutAddMenuEntry("Show Smoke (S)", 's');
+	glutAddMenuEntry("More Smoke (+)", '+');
+	glutAddMenuEntry("Less Smoke (-)", '-');
+	glutAddMenuEntry("Unsorted Smoke (O)", 'o');
+	glutAddMenuEntry("Shader Smoke (G)", 'g');
+	glutAddMenuEntry("Volume Smoke (V)", 'v');
+	glutAddMenuEntry("Turbulent Smoke (T)", 't');
+	glutAddMenuEntry("Solid Robot (C)", 'c');
+	glutAddMenuEntry("Unlit Smoke (U)", 'u');
+	glutAddMenuEntry("Next Smoke Kernel (K)", 'k');
+	glutAddMenuEntry("Save Snapshot (Z)", 'z');
+	glutAddMenuEntry("Load Snapshot (X)", 'x');
 	glutAddMenuEntry("Wireframe (W)", 'w');
+	glutAddMenuEntry("Wave (H)", 'h');
+	glutAddMenuEntry("Let Go (E)", 'e');
+	glutAddMenuEntry("Record Clip (M)", 'm');
 	glutAddMenuEntry("Reset (R)", 'r');
 	glutAddMenuEntry("Quit (Q)", 'q');
 	glutAttachMenu(GLUT_MIDDLE_BUTTON);
@@ -255,6 +423,21 @@ static void keypress(unsigned char key, int x, int y) {
 		case 'R':
 			animate(ANIM_RESET);
 			break;
+		case 'h':
+		case 'H':
+			animate_overlay(OVERLAY_WAVE, !get_overlay(OVERLAY_WAVE));
+			break;
+		case 'e':
+		case 'E':
+			animate_reach(NULL);
+			break;
+		case 'm':
+		case 'M':
+			if ( get_recording() )
+				record_stop();
+			else
+				animate_record();
+			break;
 		case 'l':
 		case 'L':
 			if ( lights_on ) {
@@ -272,6 +455,56 @@ static void keypress(unsigned char key, int x, int y) {
 		case 'S':
 		case 's':
 			particles_disp = !particles_disp;
+			if ( particles_disp )
+				particles_prewarm(prewarm);
+			break;
+		case '+':
+			particles_set_capacity(particles_get_capacity() * 2);
+			break;
+		case '-':
+			particles_set_capacity(particles_get_capacity() / 2);
+			break;
+		case 'O':
+		case 'o':
+			particles_set_oit(!particles_get_oit());
+			break;
+		case 'G':
+		case 'g':
+			particles_set_analytic(!particles_get_analytic());
+			break;
+		case 'V':
+		case 'v':
+			particles_set_volume(!particles_get_volume());
+			break;
+		case 'T':
+		case 't':
+			particles_set_turbulence(!particles_get_turbulence());
+			break;
+		case 'C':
+		case 'c':
+			particles_set_collide(!particles_get_collide());
+			break;
+		case 'U':
+		case 'u':
+			particles_set_lit(!particles_get_lit());
+			break;
+		case 'K':
+		case 'k':
+			/* round the kernels this machine can run, best first */
+			simd = particles_get_simd();
+			do
+				simd = simd ? simd - 1 : SIMD_LEVELS - 1;
+			while ( particles_set_simd(simd) != simd );
+			printf("smoke kernels: %s\n", simd_name(simd));
+			break;
+		case 'Z':
+		case 'z':
+			snapshot_save(snapshot);
+			break;
+		case 'X':
+		case 'x':
+			snapshot_load(snapshot);
+			break;
 	}
 	glutPostRedisplay();
 }
@@ -305,27 +538,76 @@ static void reshape(int width, int height) {
 	glMatrixMode(GL_PROJECTION);
 	glLoadIdentity();
 	//glOrtho(2,-2,-2,2,2,-2);
-	gluPerspective(60, (float)width/(float)height, 1.0, 15.0);
+	gluPerspective(CAMERA_FOV, (float)width/(float)height, 1.0, 15.0);
 	glMatrixMode(GL_MODELVIEW);
 	glViewport(0, 0, width, height);
 	xwidth = width;
 	yheight = height;
 }
 
+/* the time in milliseconds */
+static double now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
 /* Progresses the robot animation state 1 frame */
-static void robot_think(int n) {
-	if ( n ) n = n; /* shut up compiler */
-	glutTimerFunc ( ROBOT_MS_PER_FRAME, robot_think, 1 );
+static void robot_tick(void) {
 	animate_think();
-	if ( particles_anim && particles_disp )
+	kinematics_think();
+	if ( particles_anim && particles_disp ) {
+		quality_start();
 		particles_think();
+		quality_stop();
+	}
+	particles_set_quality(quality_frame());
+}
+
+/* Runs the ticks that have come due, and sets the timer for the next */
+static void robot_think(int n) {
+	double t = now();
+	int ticks = 0;
+
+	if ( n ) n = n; /* shut up compiler */
+	if ( tick_due < 0 )
+		tick_due = t;
+	while ( t >= tick_due ) {
+		if ( ticks++ == ROBOT_MAX_TICKS ) {
+			tick_due = t + ROBOT_MS_PER_FRAME;
+			break;
+		}
+		robot_tick();
+		tick_due += ROBOT_MS_PER_FRAME;
+	}
+	glutTimerFunc ( (unsigned int)ceil(tick_due - t), robot_think, 1 );
+}
+
+/* Redraws the scene, and sets the timer for the next draw.  A draw 
+ * that is late is put off to a whole ROBOT_MS_PER_DRAW from now rather 
+ * than caught up on. */
+static void robot_redraw(int n) {
+	double t = now();
+
+	if ( n ) n = n; /* shut up compiler */
+	if ( draw_due < 0 )
+		draw_due = t;
+	draw_due += ROBOT_MS_PER_DRAW;
+	if ( draw_due <= t )
+		draw_due = t + ROBOT_MS_PER_DRAW;
 	glutPostRedisplay();
+	glutTimerFunc ( (unsigned int)ceil(draw_due - t), robot_redraw, 1 );
 }
 
 /**************************************************************************/
 /* draw:  Draw the scene                                                  */
 /**************************************************************************/
 static void render_scene(void) {
+	joint_pose pose;
+	GLint mode;
+	float alpha = 1 - (tick_due - now()) / ROBOT_MS_PER_FRAME;
+
 	glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
 	glClearColor( 0.0, 0.0, 0.0, 0.0 );
 	glColor3f( 1.0, 1.0, 1.0);
@@ -339,16 +621,29 @@ static void render_scene(void) {
 	}
 	glLoadIdentity();
 
-	gluLookAt(0,0,4,
+	gluLookAt(0,0,CAMERA_DISTANCE,
 		0,0,0,
 		0,1,0);
 	
-	glPushMatrix();
-		render_body();
-	glPopMatrix();
-
-	if ( particles_disp ) 
-		particles_render();
+	/* the robot is drawn between the last two ticks, with the joints 
+	 * as they are between them -- including any moved by hand since */
+	if ( alpha < 0 || tick_due < 0 )
+		alpha = 0;
+	if ( alpha > 1 )
+		alpha = 1;
+	animate_lerp(alpha, &pose);
+	kinematics_pose(&pose);
+	render_body();
+
+	/* picking draws the scene too, but isn't what the budget is for */
+	glGetIntegerv(GL_RENDER_MODE, &mode);
+	if ( particles_disp ) {
+		if ( mode == GL_RENDER )
+			quality_start();
+		particles_render(alpha);
+		if ( mode == GL_RENDER )
+			quality_stop_draw();
+	}
 
 	glLoadIdentity();
 	draw_panel();
@@ -368,6 +663,18 @@ static void move(int x, int y) {
 /**************************************************************************/
 /* Mouse function -- pulled from the example from the lectures            */
 /**************************************************************************/
+/* has the nearer arm reach for the point under the mouse at (x, y), on
+ * the plane through the robot's middle that faces the camera */
+static void reach_to(int x, int y) {
+	float half = CAMERA_DISTANCE * tan(CAMERA_FOV * M_PI / 360);
+	float target[3];
+
+	target[0] = (2.0 * x / xwidth - 1) * half * xwidth / yheight;
+	target[1] = (1 - 2.0 * y / yheight) * half;
+	target[2] = 0;
+	animate_reach(target);
+}
+
 static void mouse(int button, int state, int x, int y)
 {
 	GLuint selectBuff[64];
@@ -385,12 +692,19 @@ static void mouse(int button, int state, int x, int y)
     	/* up-clicks, non-left clicks */
     	if ( state != GLUT_DOWN || button != GLUT_LEFT_BUTTON ) 
     		return;
+	if ( glutGetModifiers() & GLUT_ACTIVE_SHIFT ) {
+		reach_to(x, y);
+		return;
+	}
     
 	// 1. Def. the buffer that we are using to store infor.
 	//    names of the object 
 	// Select buffer parameters
 	glSelectBuffer(64, selectBuff);
-	glGetIntegerv(GL_VIEWPORT, viewport);
+	/* the viewport reshape set */
+	viewport[0] = viewport[1] = 0;
+	viewport[2] = xwidth;
+	viewport[3] = yheight;
 	
 	// Enter to selection mode
 	glDisable(GL_LIGHTING);
@@ -411,7 +725,7 @@ static void mouse(int button, int state, int x, int y)
 	//    e.  Need to multiply with the original PROJECTION set in Reshape func.
 	//        Equ. to glOrtho
 	//glFrustum(-7, 7, -5, 5, 10, 200);
-	gluPerspective(60, (float)xwidth/(float)yheight, 1.0, 15.0);
+	gluPerspective(CAMERA_FOV, (float)xwidth/(float)yheight, 1.0, 15.0);
 	
 	// 3.  Start getting ready to draw:
 	// 	a.  Set the current matrix to the MODELVIEW
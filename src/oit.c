@@ -0,0 +1,238 @@
+/************************************************************************** 
+ * Nanobot:  A simple, interactive robot rendered using OpenGL
+ * Copyright (C) 2007, Corey Edmunds (corey.edmunds@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *************************************************************************/
+
+
+/**************************************************************************
+ * oit.c/h
+ *
+ * Weighted, blended order independent transparency (McGuire & Bavoil).
+ * Transparent geometry drawn between oit_begin() and oit_end() is summed
+ * in to an accumulation target (weighted premultiplied colour) and a 
+ * revealage target, and oit_end() composites the average colour over 
+ * the scene.  Nothing needs to be sorted.
+ *
+ * Revealage is a product of (1 - alpha), which would need its own blend
+ * function; it is kept as a sum of -log(1 - alpha) instead so every 
+ * target can share additive blending.  That only needs GL 3.0, which 
+ * Mesa's software renderers have.
+ *************************************************************************/
+#include "shader.h"
+#include "oit.h"
+#include <stdio.h>
+
+/* draws textured, vertex coloured geometry in to the two targets.  The 
+ * weight falls off with eye distance so nearer smoke dominates.  Other 
+ * vertex shaders can be used with accum_fs (see oit_program) as long as
+ * they write the same varyings and gl_TexCoord[0]. */
+static const char *accum_vs =
+	"#version 120\n"
+	"uniform vec3 ambient;\n"
+	"varying vec4 color;\n"
+	"varying float depth;\n"
+	"void main() {\n"
+	"	vec4 eye = gl_ModelViewMatrix * gl_Vertex;\n"
+	"	depth = -eye.z;\n"
+	"	color = vec4(gl_Color.rgb * ambient, gl_Color.a);\n"
+	"	gl_TexCoord[0] = gl_MultiTexCoord0;\n"
+	"	gl_Position = gl_ProjectionMatrix * eye;\n"
+	"}\n";
+static const char *accum_fs =
+	"#version 120\n"
+	"uniform sampler2D tex;\n"
+	"varying vec4 color;\n"
+	"varying float depth;\n"
+	"void main() {\n"
+	"	float a = min(color.a * texture2D(tex, gl_TexCoord[0].st).a, 0.999);\n"
+	"	float w = a * clamp(10.0 / (1e-5 + pow(depth / 5.0, 2.0) + \n"
+	"		pow(depth / 200.0, 6.0)), 1e-2, 3e3);\n"
+	"	gl_FragData[0] = vec4(color.rgb * w, w);\n"
+	"	gl_FragData[1] = vec4(-log(1.0 - a));\n"
+	"}\n";
+
+/* resolves the targets over the scene, drawn as a full screen rectangle */
+static const char *composite_vs =
+	"#version 120\n"
+	"void main() {\n"
+	"	gl_Position = gl_Vertex;\n"
+	"}\n";
+static const char *composite_fs =
+	"#version 120\n"
+	"uniform sampler2D accum;\n"
+	"uniform sampler2D reveal;\n"
+	"uniform vec2 size;\n"
+	"void main() {\n"
+	"	vec2 uv = gl_FragCoord.xy / size;\n"
+	"	vec4 sum = texture2D(accum, uv);\n"
+	"	float alpha = 1.0 - exp(-texture2D(reveal, uv).r);\n"
+	"	if ( alpha < 1.0/512.0 )\n"
+	"		discard;\n"
+	"	gl_FragColor = vec4(sum.rgb / max(sum.a, 1e-5), alpha);\n"
+	"}\n";
+
+static GLuint accum_program;
+static GLuint composite_program;
+
+/* the framebuffer and its targets, sized to the viewport */
+static GLuint fbo;
+static GLuint accum_tex;
+static GLuint reveal_tex;
+static GLuint depth_tex;
+static int width;
+static int height;
+
+/* makes a screen sized texture for a target */
+static void oit_texture(GLuint tex, GLint format, GLenum type, int w, int h) {
+	glBindTexture(GL_TEXTURE_2D, tex);
+	glTexImage2D(GL_TEXTURE_2D, 0, format, w, h, 0, 
+		format == GL_DEPTH_COMPONENT24 ? GL_DEPTH_COMPONENT : GL_RGBA, 
+		type, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+/* (re)allocates the targets for a w x h viewport */
+static void oit_resize(int w, int h) {
+	oit_texture(accum_tex, GL_RGBA16F, GL_FLOAT, w, h);
+	oit_texture(reveal_tex, GL_R16F, GL_FLOAT, w, h);
+	oit_texture(depth_tex, GL_DEPTH_COMPONENT24, GL_UNSIGNED_INT, w, h);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, 
+		GL_TEXTURE_2D, accum_tex, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, 
+		GL_TEXTURE_2D, reveal_tex, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, 
+		GL_TEXTURE_2D, depth_tex, 0);
+	if ( glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE )
+		printf("%s %d:  Transparency framebuffer incomplete\n", 
+			__FILE__, __LINE__);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	width = w;
+	height = h;
+}
+
+/* sets up the programs and targets.  Returns 0 if GL can't do it. */
+int init_oit(void) {
+	if ( accum_program )
+		return 1;
+	if ( !gl_version(3, 0) ) {
+		printf("Order independent transparency needs OpenGL 3.0\n");
+		return 0;
+	}
+
+	accum_program = shader_program(accum_vs, accum_fs);
+	composite_program = shader_program(composite_vs, composite_fs);
+	if ( !accum_program || !composite_program ) {
+		glDeleteProgram(accum_program);
+		glDeleteProgram(composite_program);
+		accum_program = composite_program = 0;
+		return 0;
+	}
+
+	glGenFramebuffers(1, &fbo);
+	glGenTextures(1, &accum_tex);
+	glGenTextures(1, &reveal_tex);
+	glGenTextures(1, &depth_tex);
+	return 1;
+}
+
+/* links a vertex shader with the accumulation fragment shader, for 
+ * geometry that needs more than accum_vs does.  The shader must write 
+ * the color and depth varyings and gl_TexCoord[0], and take the ambient
+ * uniform.  init_oit must have succeeded.  Returns 0 on failure. */
+GLuint oit_program(const char *vertex) {
+	return shader_program(vertex, accum_fs);
+}
+
+/* starts drawing transparent geometry.  The scene's depth is copied in 
+ * so it still hides the geometry behind it.  ambient scales the vertex 
+ * colours.  The geometry should use texture unit 0 for its alpha.  It 
+ * is drawn with program, from oit_program, or 0 for the plain one; the 
+ * program is left in use so the caller can set its other uniforms. */
+void oit_begin(GLuint program, const float *ambient) {
+	static const GLenum targets[2] = { 
+		GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 
+	};
+	static const float zero[4] = { 0, 0, 0, 0 };
+	GLint viewport[4];
+	GLint bound;
+
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &bound);
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	if ( viewport[2] != width || viewport[3] != height )
+		oit_resize(viewport[2], viewport[3]);
+
+	glBindTexture(GL_TEXTURE_2D, depth_tex);
+	glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 
+		viewport[0], viewport[1], width, height);
+	glBindTexture(GL_TEXTURE_2D, bound);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glDrawBuffers(2, targets);
+	glClearBufferfv(GL_COLOR, 0, zero);
+	glClearBufferfv(GL_COLOR, 1, zero);
+
+	glPushAttrib(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_VIEWPORT_BIT);
+	glViewport(0, 0, width, height);
+	glEnable(GL_DEPTH_TEST);
+	glDepthMask(GL_FALSE);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE);
+
+	if ( !program )
+		program = accum_program;
+	glUseProgram(program);
+	glUniform1i(glGetUniformLocation(program, "tex"), 0);
+	glUniform3fv(glGetUniformLocation(program, "ambient"), 1, ambient);
+}
+
+/* finishes drawing transparent geometry and composites it over the 
+ * scene */
+void oit_end(void) {
+	glPopAttrib();
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	glPushAttrib(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_ENABLE_BIT);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_CULL_FACE);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	glUseProgram(composite_program);
+	glUniform1i(glGetUniformLocation(composite_program, "accum"), 0);
+	glUniform1i(glGetUniformLocation(composite_program, "reveal"), 1);
+	glUniform2f(glGetUniformLocation(composite_program, "size"), 
+		width, height);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, reveal_tex);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, accum_tex);
+	glRectf(-1, -1, 1, 1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
+
+	glUseProgram(0);
+	glPopAttrib();
+}
@@ -0,0 +1,43 @@
+/************************************************************************** 
+ * Nanobot:  A simple, interactive robot rendered using OpenGL
+ * Copyright (C) 2007, Corey Edmunds (corey.edmunds@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *************************************************************************/
+
+
+/**************************************************************************
+ * oit.c/h
+ *
+ * Weighted, blended order independent transparency (McGuire & Bavoil).
+ * Transparent geometry drawn between oit_begin() and oit_end() is summed
+ * in to an accumulation target (weighted premultiplied colour) and a 
+ * revealage target, and oit_end() composites the average colour over 
+ * the scene.  Nothing needs to be sorted.
+ *
+ * Revealage is a product of (1 - alpha), which would need its own blend
+ * function; it is kept as a sum of -log(1 - alpha) instead so every 
+ * target can share additive blending.  That only needs GL 3.0, which 
+ * Mesa's software renderers have.
+ *************************************************************************/
+#ifndef __OIT_H
+#define __OIT_H
+#include "shader.h"
+
+int init_oit(void);
+GLuint oit_program(const char *vertex);
+void oit_begin(GLuint program, const float *ambient);
+void oit_end(void);
+#endif
@@ -18,29 +18,219 @@
  *************************************************************************/
 
 #include "particles.h"
+#include "stream.h"
+#include "shader.h"
+#include "oit.h"
 #include <GL/gl.h>
 #include <GL/glut.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <stddef.h>
 #include "joint.h"
 #include "draw.h"	
-#include "materials.h"
-#ifdef NO_SMOKELIGHT
-	#define PARTICLE_COUNT 512
-#else
-	#define PARTICLE_COUNT 4000
+#include "sort.h"
+#include "grid.h"
+#include "volume.h"
+#include "curl.h"
+#include "collide.h"
+#include "matrix.h"
+#include "rng.h"
+#include "workers.h"
+#include "emitter.h"
+#include "quality.h"
+#include "cpu.h"
+#ifdef SIMD_X86
+	#include <immintrin.h>
 #endif
+/* the limits on the pool size */
+#define PARTICLE_MIN_COUNT 8
+#define PARTICLE_MAX_COUNT (1 << 22)
 #define PARTICLE_WIDTH 0.24
 #define MAX_LIFESPAN 200
+/* the number of particles the think kernel updates at once.  The pool is
+ * padded out to a multiple of this so the kernel never needs a tail loop */
+#define PARTICLE_LANES 8
+#define PARTICLE_ROUND(n) \
+	(((n) + PARTICLE_LANES - 1) / PARTICLE_LANES * PARTICLE_LANES)
+/* the number of arrays in the pool */
+#define PARTICLE_ARRAYS 8
+/* particles are thought about in chunks of this many, each with its own
+ * random number stream.  The chunks, not the threads, decide the streams,
+ * so the smoke comes out the same for any number of threads. */
+#define PARTICLE_CHUNK 512
+/* the number of random floats it takes to spawn a particle, and the 
+ * number of particles spawned per batch of random numbers */
+#define PARTICLE_RANDOMS 6
+#define PARTICLE_SPAWN_BATCH 64
+/* particles closer than PARTICLE_SPACING push each other apart, by up to
+ * PARTICLE_PUSH a tick.  Only the first PARTICLE_NEIGHBORS within reach
+ * count, which keeps the cost per particle bounded in the dense smoke 
+ * at the emitters. */
+#define PARTICLE_SPACING 0.12f
+#define PARTICLE_PUSH 0.002f
+#define PARTICLE_NEIGHBORS 24
+/* the density a particle's worth of smoke adds to the volume */
+#define PARTICLE_PUFF 0.15f
+/* how far the turbulence carries a particle in a tick, on average */
+#define PARTICLE_SWIRL 0.006f
+/* gravity (well, buoyancy -- smoke rises) and the floor height */
+#define PARTICLE_LIFT 0.001f
+#define PARTICLE_FLOOR -1.5f
 
-
-static double particle_depth(particle_t *p);
-static int particle_compar(const void *vp1, const void *vp2);
+static void particle_spawn(int i, const emitter_t *e, const float *rnd);
+static void particle_bounce(int i, rng_t *rng);
+static void particles_integrate_c(int start, int end, rng_t *rng);
+#ifdef SIMD_X86
+SIMD_TARGET("sse2")
+static void particles_integrate_sse2(int start, int end, rng_t *rng);
+SIMD_TARGET("avx")
+static void particles_integrate_avx(int start, int end, rng_t *rng);
+#endif
+static void particles_swirl(int start, int end);
+static void particles_think_chunk(int n, void *arg);
+static void particles_separate_chunk(int n, void *arg);
+static void particles_spawn(void);
+static void particles_compact(void);
 static void sort_particles(void);
+static void particles_recount(void);
+static void thruster_emitters(void);
+static int ring_init(int slots);
+static void ring_free(void);
+static int ring_room(int want);
+static void ring_spawn(const emitter_t *e, const float *rnd);
+static void ring_upload(void);
+static void particles_render_analytic(int oit, float alpha);
+static void volume_spawn(void);
+
+/* the particle pool.  It is a structure of arrays rather than an array
+ * of particle_t so the think kernel can load a whole vector of each
+ * component at once.  The arrays share one block, each capacity rounded
+ * up to PARTICLE_LANES long and aligned for the widest vector unit we
+ * build for.
+ *
+ * The live particles are kept packed in [0, live).  A particle that dies
+ * is replaced by the last live one, so [live, capacity) is the free list
+ * and new particles are taken from its front.  Nothing ever has to look
+ * at a dead particle.  source is the emitter each particle came from. */
+static struct {
+	float *x;
+	float *y;
+	float *z;
+	float *vx;
+	float *vy;
+	float *vz;
+	float *life;
+	float *depth;
+	int *source;
+	void *block;
+	int live;
+	int capacity;
+} particles;
+
+/* the render order (back to front), filled in by sort_particles */
+static key_sort order;
+
+/* the particles by where they are, rebuilt each tick for separation */
+static spatial_grid neighbors;
+
+/* a smoke vertex, as streamed to GL */
+typedef struct {
+	float pos[3];
+	float tex[2];
+	unsigned char color[4];
+} smoke_vertex;
+
+/* the vertex stream the smoke is drawn from, one quad per particle in
+ * the pool */
+static quad_stream smoke;
 
+/* whether the smoke is drawn with order independent transparency (and
+ * so never sorted) */
+static int oit_on = 0;
 
-static particle_t particles[PARTICLE_COUNT];
+/* a particle in analytic mode, as streamed to GL.  Only the spawn state
+ * is kept: the vertex shader works out where the particle has got to 
+ * from its age.  It goes in through the fixed function attributes, the
+ * spawn position as the vertex, the spawn velocity as the normal, and 
+ * the quad corner, birth tick and lifespan as the texture coordinates. */
+typedef struct {
+	float pos[3];
+	float vel[3];
+	float tex[4];
+	unsigned char color[4];
+} analytic_vertex;
+
+/* the analytic mode's particles.  Particles are written to the slots in
+ * turn, round and round, and stay there until they are written over; 
+ * a slot is only reused once its particle has died.  The slots written
+ * since the last frame are sent to GL before it is drawn.  dying counts
+ * each emitter's particles by the tick they die on, so the emitters' 
+ * live counts can be kept without looking at the particles. */
+static struct {
+	quad_stream stream;
+	analytic_vertex *vertices;
+	float *death;
+	int slots;
+	int head;
+	int dirty_first;
+	int dirty_count;
+	int dying[MAX_LIFESPAN][MAX_EMITTERS];
+} ring;
+
+/* whether the smoke is in analytic mode, or volumetric (see volume.c) */
+static int analytic_on = 0;
+static int volume_on = 0;
+/* whether the particles are carried along the turbulence field */
+static int turbulence_on = 0;
+/* whether the particles are kept out of the robot */
+static int collide_on = 1;
+/* the analytic mode's programs, plain and for order independent 
+ * transparency */
+static GLuint analytic_program;
+static GLuint analytic_oit_program;
+
+/* works out an analytic particle's position, colour and fade from its
+ * age, the same as the think kernel would have got to tick by tick.
+ * The floor bounce, which scatters the particle randomly, is stood in 
+ * for by folding the path back up off the floor.  Dead and unborn 
+ * particles are put outside the clip volume. */
+static const char *analytic_vs =
+	"#version 120\n"
+	"uniform vec3 ambient;\n"
+	"uniform float now;\n"
+	"uniform float width;\n"
+	"uniform float alpha;\n"
+	"uniform float lift;\n"
+	"uniform float ground;\n"
+	"uniform float lifespan;\n"
+	"varying vec4 color;\n"
+	"varying float depth;\n"
+	"void main() {\n"
+	"	float age = now - gl_MultiTexCoord0.z;\n"
+	"	float life = gl_MultiTexCoord0.w - age;\n"
+	"	vec3 pos = gl_Vertex.xyz + gl_Normal * age;\n"
+	"	vec4 eye;\n"
+	"	pos.y += lift * age * (age + 1.0) * 0.5;\n"
+	"	if ( pos.y < ground )\n"
+	"		pos.y = ground + (ground - pos.y) * 0.1;\n"
+	"	pos.xy += gl_MultiTexCoord0.xy * width;\n"
+	"	eye = gl_ModelViewMatrix * vec4(pos, 1.0);\n"
+	"	depth = -eye.z;\n"
+	"	color = vec4(gl_Color.rgb * ambient, alpha * life / lifespan);\n"
+	"	gl_TexCoord[0] = vec4(gl_MultiTexCoord0.xy * 0.5 + 0.5, 0.0, 1.0);\n"
+	"	gl_Position = gl_ProjectionMatrix * eye;\n"
+	"	if ( age < 0.0 || life <= 0.0 )\n"
+	"		gl_Position = vec4(0.0, 0.0, 2.0, 1.0);\n"
+	"}\n";
+static const char *analytic_fs =
+	"#version 120\n"
+	"uniform sampler2D tex;\n"
+	"varying vec4 color;\n"
+	"void main() {\n"
+	"	gl_FragColor = vec4(color.rgb, \n"
+	"		color.a * texture2D(tex, gl_TexCoord[0].st).a);\n"
+	"}\n";
 
 static enum smoke_color sm_color = SM_LIGHTGREY;
 
@@ -55,192 +245,262 @@ static float colors[8][3] = {
 	{0, 1, 0}	/*SM_GREEN*/
 };
 
-/* the modelview matrix for 1 nacelle */
-static float matrix1[16];
-/* the modelview matrix for 2nd nacelle */
-static float matrix2[16];
-/* the look-at matrix, used for depth sorting */
-static float lookat[16];
+/* the emitters at the back of the right and left thrusters */
+static int thrusters[2] = { -1, -1 };
+
+/* the third row of the look-at matrix; dotted with a position it gives
+ * the eye-space depth used for sorting */
+static float depth_row[4];
+
+/* the quality level, which scales the emitters' rates and budgets, and
+ * the quad half-width and peak opacity that make up for it */
+static float quality = 1;
+static float quad_width = PARTICLE_WIDTH;
+static float quad_alpha = 0.5;
+
+/* the vector unit the kernels use, and the think kernel for it */
+static enum simd_level simd = SIMD_NONE;
+static void (*integrate)(int start, int end, rng_t *rng) = 
+	particles_integrate_c;
+
+/* whether the smoke picks up the scene's ambient light */
+static int lit_on = 1;
 
-/* Positions and directions of the nacelles (particle sources) */
-static vec4f p1;
-static vec4f v1;
-static vec4f p2;
-static vec4f v2;
+/* the tick count, mixed in to the seed so every tick gets fresh random
+ * number streams */
+static uint64_t particle_tick;
 
 /* The smoke texture */
 static int texid;
 
-static void load_matrixes(float *matrix, int left) {
-	glPushMatrix();
-		glLoadIdentity();	
-		glRotatef(X_ROT(SL_BODY), 0, 1, 0);
-		glRotatef(Y_ROT(SL_BODY), 1, 0, 0);
-		glRotatef(Z_ROT(SL_BODY), 0, 0, 1);
-		if ( left ) {
-			/* translate out to pylon sphere position */
-			glRotatef(90, 0, 1, 0);
-			glRotatef(-40, 1, 0, 0);
-			glTranslatef(0, 0, 0.90);
-			/* rotate to the thruster attachment angle */
-			glRotatef(10, 1, 0, 0);
-			/* translate thruster out */
-			glTranslatef(0, 0, 0.55);
-			/* apply animation/rotation to thruster */
-			glRotatef(Y_ROT(SL_L_THRUSTER), 0, 0, 1);
-			/* unrotate the thruster so the back end looks straight */
-			glRotatef(30, 1, 0, 0);
-			/* flip thruster around so it points the right way */
-			glRotatef(180, 0, 0, 1);
-			/* flip the thruster 90 degrees so it points the right way */
-			glRotatef(90, 0, 1, 0);
-		} else {
-			/* translate out to pylon sphere position */
-			glRotatef(-90, 0, 1, 0);
-			glRotatef(-40, 1, 0, 0);
-			glTranslatef(0, 0, 0.90);
-			/* rotate to the thruster attachment angle */
-			glRotatef(10, 1, 0, 0);
-			/* translate thruster out */
-			glTranslatef(0, 0, 0.55);
-			/* apply animation/rotation to thruster */
-			glRotatef(-Y_ROT(SL_R_THRUSTER), 0, 0, 1);
-			/* unrotate the thruster so the back end looks straight */
-			glRotatef(30, 1, 0, 0);
-			/* flip the thruster 90 degrees so it points the right way */
-			glRotatef(90, 0, 1, 0);
-		}
-		glGetFloatv(GL_MODELVIEW_MATRIX, matrix);
-	glPopMatrix();
+/* sorts the particles back to front.  The particles barely move between
+ * frames, so the last frame's order is reused as a starting point. */
+static void sort_particles(void) {
+	key_sort_coherent(&order, particles.depth, particles.live);
 }
 
-vec4f m_mult(float *m, vec4f v) {
-	vec4f r;
-	int i;
-	int j;
-
-	for(i=0; i<4; i++) {
-		r.v[i] = 0;
-		for(j=0; j<4; j++) 
-			r.v[i] += m[j*4+i] * v.v[j];
-	}	
+/* writes the 4 vertices of particle i's quad */
+static void particle_quad(smoke_vertex *v, int i, const unsigned char *color) {
+	static const float corners[4][2] = { {-1, 1}, {-1, -1}, {1, -1}, {1, 1} };
+	int c;
 
-	return r;
+	for(c=0; c<4; c++) {
+		v[c].pos[0] = particles.x[i] + corners[c][0] * quad_width;
+		v[c].pos[1] = particles.y[i] + corners[c][1] * quad_width;
+		v[c].pos[2] = particles.z[i];
+		v[c].tex[0] = corners[c][0] > 0;
+		v[c].tex[1] = corners[c][1] > 0;
+		v[c].color[0] = color[0];
+		v[c].color[1] = color[1];
+		v[c].color[2] = color[2];
+		v[c].color[3] = 255 * quad_alpha * particles.life[i] / ((float)MAX_LIFESPAN);
+	}
 }
 
-static double particle_depth(particle_t *p) {
-	vec4f pos = m_mult(lookat, (vec4f)p->pos);
-	//double d = sqrt(p->pos.x * p->pos.x + p->pos.y * p->pos.y + (p->pos.z - 4.0)*(p->pos.z - 4.0)); 
-	return pos.p.z;
+/* works out how much the smoke is lit this frame.  The lit smoke only
+ * picks up ambient light (GL_LIGHT3 has no diffuse or specular), so 
+ * lighting it comes down to scaling its colour by the light model's 
+ * ambient plus GL_LIGHT3's when the lights are on. */
+static void smoke_shade(float *shade) {
+	extern int lights_on;
+	float model[4];
+	float light[4] = { 0, 0, 0, 0 };
+	int i;
+
+	if ( !lit_on ) {
+		shade[0] = shade[1] = shade[2] = 1;
+		return;
+	}
+	glGetFloatv(GL_LIGHT_MODEL_AMBIENT, model);
+	if ( lights_on ) 
+		glGetLightfv(GL_LIGHT3, GL_AMBIENT, light);
+	for(i=0; i<3; i++)
+		shade[i] = model[i] + light[i];
 }
 
-static int particle_compar(const void *vp1, const void *vp2) {
-	particle_t *pp1 = (particle_t*)vp1;
-	particle_t *pp2 = (particle_t*)vp2;
+/* works out each emitter's smoke colour for this frame.  The lighting is
+ * done once here and the result goes out as the vertex colour, so the 
+ * lit smoke costs the same as the unlit smoke. */
+static void smoke_color(unsigned char color[MAX_EMITTERS][3]) {
+	float shade[3];
+	float c;
+	int e, i;
 
-	return pp2->depth < pp1->depth;
+	smoke_shade(shade);
+	for(e=0; e<MAX_EMITTERS; e++)
+		for(i=0; i<3; i++) {
+			c = emitters[e].color[i] * shade[i];
+			color[e][i] = c >= 1 ? 255 : 255 * c;
+		}
 }
 
-static void sort_particles(void) {
-	qsort(particles, PARTICLE_COUNT, sizeof(particle_t), particle_compar);
-}
+/* draws the smoke.  Every live particle is written to the vertex stream
+ * back to front in one pass, then drawn unlit with a single call.
+ *
+ * With order independent transparency on the particles go out in pool 
+ * order, unsorted, and are blended by the OIT pass instead.  Selection 
+ * mode always takes the plain path.
+ *
+ * The screen is drawn alpha of the way from the tick before the latest
+ * to the latest, like the robot (see animate_lerp).  Only the analytic
+ * mode, which works each particle out from its age, can draw between 
+ * them; the others draw the smoke as the latest tick left it. */
+void particles_render(float alpha) {
+	static const float ambient[3] = { 1, 1, 1 };
+	unsigned char color[MAX_EMITTERS][3];
+	smoke_vertex *v;
+	char *base;
+	GLint mode;
+	int i, j, quads, oit;
 
-void particles_render(void) {
-	extern int lights_on;
-	int i;
-	float diffuse[4] = { 1, 1, 1, 0 };
-	float mag;
-	sort_particles();
+	glGetIntegerv(GL_RENDER_MODE, &mode);
+	oit = oit_on && mode == GL_RENDER;
+	if ( volume_on ) {
+		if ( mode == GL_RENDER ) {
+			float shade[3];
 
-#ifdef NO_SMOKELIGHT	
-	glDisable(GL_LIGHTING);
-#else
-	if ( lights_on ) {
-		glDisable(GL_LIGHT0);
-		glEnable(GL_LIGHT3);
+			smoke_shade(shade);
+			for(i=0; i<3; i++)
+				shade[i] *= colors[sm_color][i];
+			volume_render(shade);
+		}
+		return;
 	}
-	apply_mat(MAT_SMOKE);
-#endif
+	if ( analytic_on ) {
+		/* the shaders don't take part in selection */
+		if ( mode == GL_RENDER )
+			particles_render_analytic(oit, alpha);
+		return;
+	}
+	if ( !oit )
+		sort_particles();
+	v = quad_stream_map(&smoke);
+	if ( !v )
+		return;
+
+	smoke_color(color);
+	quads = 0;
+	for(j=0; j<particles.live; j++) {
+		i = oit ? j : KEY_SORT_INDEX(&order, j);
+		particle_quad(&v[quads * 4], i, color[particles.source[i]]);
+		quads++;
+	}
+	base = quad_stream_unmap(&smoke);
+
+	glPushAttrib(GL_ENABLE_BIT);
+	glDisable(GL_LIGHTING);
 	glEnable(GL_BLEND);
 	glBlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 	glEnable(GL_TEXTURE_2D);
 	glBindTexture(GL_TEXTURE_2D, texid);
 	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
-	glBegin(GL_QUADS);
 
-	for(i=0; i<PARTICLE_COUNT; i++) {
-		if ( particles[i].lifespan <= 0 )
-			continue;
-#ifndef NO_SMOKELIGHT
-			mag = sqrt(
-				particles[i].pos.x*particles[i].pos.x + 
-				particles[i].pos.y*particles[i].pos.y + 
-				particles[i].pos.z*particles[i].pos.z);
-			mag /= 2;
-			glNormal3f(
-				-particles[i].pos.x/mag,
-				-particles[i].pos.y/mag,
-				-particles[i].pos.z/mag
-			);
-		
-			diffuse[0] = colors[sm_color][0]; 
-			diffuse[1] = colors[sm_color][1]; 
-			diffuse[2] = colors[sm_color][2];
-			diffuse[3] = 0.5 * (float)particles[i].lifespan / ((float)MAX_LIFESPAN);
-			glMaterialfv(GL_FRONT, GL_AMBIENT, diffuse);
-			glMaterialfv(GL_FRONT, GL_DIFFUSE, diffuse);
-#else
-			glColor4f(
-				colors[sm_color][0], 
-				colors[sm_color][1], 
-				colors[sm_color][2], 
-				0.5 * (float)particles[i].lifespan / ((float)MAX_LIFESPAN)
-			);
-#endif
-			glTexCoord2f(0,1);
-			glVertex3f(
-				particles[i].pos.x - PARTICLE_WIDTH, 
-				particles[i].pos.y + PARTICLE_WIDTH, 
-				particles[i].pos.z
-			);
-			glTexCoord2f(0,0);
-			glVertex3f(
-				particles[i].pos.x -PARTICLE_WIDTH, 
-				particles[i].pos.y - PARTICLE_WIDTH, 
-				particles[i].pos.z
-			);
-			glTexCoord2f(1,0);
-			glVertex3f(
-				particles[i].pos.x + PARTICLE_WIDTH, 
-				particles[i].pos.y - PARTICLE_WIDTH, 
-				particles[i].pos.z
-			);
-			glTexCoord2f(1,1);
-			glVertex3f(
-				particles[i].pos.x + PARTICLE_WIDTH, 
-				particles[i].pos.y + PARTICLE_WIDTH, 
-				particles[i].pos.z
-			);
-	}
-	glEnd();
-	glDisable(GL_COLOR_MATERIAL);
-	glDisable(GL_TEXTURE_2D);
-	glDisable(GL_BLEND);
-	if ( lights_on ) {
-		glEnable(GL_LIGHT0);
-		glDisable(GL_LIGHT3);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+	glVertexPointer(3, GL_FLOAT, sizeof(smoke_vertex), 
+		base + offsetof(smoke_vertex, pos));
+	glTexCoordPointer(2, GL_FLOAT, sizeof(smoke_vertex), 
+		base + offsetof(smoke_vertex, tex));
+	glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(smoke_vertex), 
+		base + offsetof(smoke_vertex, color));
+
+	if ( oit ) {
+		oit_begin(0, ambient);
+		quad_stream_draw(&smoke, quads);
+		oit_end();
+	} else {
+		quad_stream_draw(&smoke, quads);
 	}
+
+	glDisableClientState(GL_COLOR_ARRAY);
+	glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glPopAttrib();
+}
+
+/* draws the analytic mode's smoke.  Every slot is drawn; the shader 
+ * throws away the ones without a live particle.  The slots are in spawn
+ * order, not depth order, so without order independent transparency the
+ * blending is only roughly right.  The particles are drawn alpha of 
+ * the way from the tick before the latest to the latest. */
+static void particles_render_analytic(int oit, float alpha) {
+	float shade[3];
+	GLuint program;
+	char *base;
+
+	if ( oit && !analytic_oit_program ) 
+		analytic_oit_program = oit_program(analytic_vs);
+	if ( !analytic_oit_program )
+		oit = 0;
+	ring_upload();
+	smoke_shade(shade);
+	base = quad_stream_bind(&ring.stream);
+
+	glPushAttrib(GL_ENABLE_BIT | GL_DEPTH_BUFFER_BIT);
+	glDisable(GL_LIGHTING);
+	glDepthMask(GL_FALSE);
+	glEnable(GL_BLEND);
+	glBlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glEnable(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D, texid);
+
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+	glVertexPointer(3, GL_FLOAT, sizeof(analytic_vertex), 
+		base + offsetof(analytic_vertex, pos));
+	glNormalPointer(GL_FLOAT, sizeof(analytic_vertex), 
+		base + offsetof(analytic_vertex, vel));
+	glTexCoordPointer(4, GL_FLOAT, sizeof(analytic_vertex), 
+		base + offsetof(analytic_vertex, tex));
+	glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(analytic_vertex), 
+		base + offsetof(analytic_vertex, color));
+
+	if ( oit ) {
+		program = analytic_oit_program;
+		oit_begin(program, shade);
+	} else {
+		program = analytic_program;
+		glUseProgram(program);
+		glUniform1i(glGetUniformLocation(program, "tex"), 0);
+		glUniform3fv(glGetUniformLocation(program, "ambient"), 1, shade);
+	}
+	glUniform1f(glGetUniformLocation(program, "now"), 
+		(float)particle_tick - 1 + alpha);
+	glUniform1f(glGetUniformLocation(program, "width"), quad_width);
+	glUniform1f(glGetUniformLocation(program, "alpha"), quad_alpha);
+	glUniform1f(glGetUniformLocation(program, "lift"), PARTICLE_LIFT);
+	glUniform1f(glGetUniformLocation(program, "ground"), PARTICLE_FLOOR);
+	glUniform1f(glGetUniformLocation(program, "lifespan"), MAX_LIFESPAN);
+	quad_stream_draw(&ring.stream, ring.slots);
+	if ( oit )
+		oit_end();
+	glUseProgram(0);
+
+	glDisableClientState(GL_COLOR_ARRAY);
+	glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glPopAttrib();
 }
 
 void init_particles(void) {
+	static const float eye[3] = { 0, 0, 4 };
+	static const float center[3] = { 0, 0, 0 };
+	static const float up[3] = { 0, 1, 0 };
 	unsigned char tex[32][32][1];
+	float lookat[16];
 	int i, j;
 	
-	gluLookAt(0,0,4,
-		0,0,0,
-		0,1,0);
-		
-	glGetFloatv(GL_MODELVIEW_MATRIX, lookat);
+	/* the look-at nanobot.c draws with */
+	m_identity(lookat);
+	m_look_at(lookat, eye, center, up);
+	/* only the eye-space z is needed for sorting, which is the dot
+	 * product of the position with the third row of the look-at */
+	for ( i = 0; i<4; i++ )
+		depth_row[i] = lookat[i*4+2];
 	
 	for ( i = 0; i<32; i++ ) 
 		for( j=0; j<32; j++ ) {
@@ -260,79 +520,888 @@ void init_particles(void) {
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);	
 	glDisable(GL_TEXTURE_2D);
-	memset(particles, 0, sizeof(particles));
+	if ( !particles_set_capacity(PARTICLE_DEFAULT_COUNT) ) {
+		fprintf(stderr, "%s %d:  Out of memory\n", __FILE__, __LINE__);
+		exit(1);
+	}
+	particles_set_simd(simd_best());
 }
 
-void particle_recycle(particle_t *p) {
-	vec4f pos;
-	vec4f vel;
-	
-	if ( rand() > RAND_MAX/2 ) {
-		pos = p1;
-		vel = v1;
-	} else {
-		pos = p2;
-		vel = v2;
+/* picks the vector unit the particle kernels use.  Returns the one in 
+ * use, which is unchanged if this CPU (or build) can't do level. */
+enum simd_level particles_set_simd(enum simd_level level) {
+	if ( !simd_supported(level) )
+		return simd;
+	switch ( level ) {
+#ifdef SIMD_X86
+		case SIMD_AVX:
+			integrate = particles_integrate_avx;
+			break;
+		case SIMD_SSE2:
+			integrate = particles_integrate_sse2;
+			break;
+#endif
+		default:
+			integrate = particles_integrate_c;
+			break;
 	}
-	
-	p->pos.x = pos.p.x + ((float)rand())/((float)RAND_MAX) * 0.30 - 0.15;
-	p->pos.y = pos.p.y + ((float)rand())/((float)RAND_MAX) * 0.30 - 0.15;
-	p->pos.z = pos.p.z;
-	p->vel.x = vel.p.x/10.0 + ((float)rand())/((float)RAND_MAX) * 0.01 - 0.005;
-	p->vel.y = vel.p.y/10.0 + ((float)rand())/((float)RAND_MAX) * 0.01 - 0.005;
-	p->vel.z = vel.p.z/10.0 + ((float)rand())/((float)RAND_MAX) * 0.01 - 0.005;
-	p->lifespan = rand()%(MAX_LIFESPAN/3) + MAX_LIFESPAN/3;
-}
-
-void particle_think(particle_t *p) {
-	p->vel.y += 0.001;
-	p->pos.x += p->vel.x;
-	p->pos.y += p->vel.y;
-	p->pos.z += p->vel.z;
-	
-	if ( p->pos.y < -1.5 ) {
-		p->vel.y *= -0.1;
-		p->vel.x += 2 * (((float)rand())/((float)RAND_MAX) * p->vel.y - 0.5 * p->vel.y);
-		p->vel.z += 2 * (((float)rand())/((float)RAND_MAX) * p->vel.y - 0.5 * p->vel.y);
-		p->vel = normalize(p->vel);
-		p->vel.x /= 10.0;
-		p->vel.y /= 10.0;
-		p->vel.z /= 10.0;
-	
+	collide_set_simd(level);
+	simd = level;
+	return simd;
+}
+
+/* the vector unit the particle kernels use */
+enum simd_level particles_get_simd(void) {
+	return simd;
+}
+
+/* turns the smoke's lighting on or off.  Either way the lighting is 
+ * worked out once a frame, not per particle. */
+void particles_set_lit(int on) {
+	lit_on = on;
+}
+
+/* whether the smoke is lit */
+int particles_get_lit(void) {
+	return lit_on;
+}
+
+/* resizes the particle pool to hold up to capacity particles.  The live
+ * particles that fit are kept.  Must be called from the GL thread.  
+ * Returns 0 (leaving the pool as it was) on failure. */
+int particles_set_capacity(int capacity) {
+	float **arrays[PARTICLE_ARRAYS] = {
+		&particles.x, &particles.y, &particles.z,
+		&particles.vx, &particles.vy, &particles.vz,
+		&particles.life, &particles.depth
+	};
+	size_t slots;
+	void *block;
+	key_sort ks;
+	quad_stream qs;
+	spatial_grid grid;
+	int *source;
+	int live, i;
+
+	if ( capacity < PARTICLE_MIN_COUNT )
+		capacity = PARTICLE_MIN_COUNT;
+	if ( capacity > PARTICLE_MAX_COUNT )
+		capacity = PARTICLE_MAX_COUNT;
+	slots = PARTICLE_ROUND(capacity);
+
+	if ( posix_memalign(&block, 32, 
+			(sizeof(float) * PARTICLE_ARRAYS + sizeof(int)) * slots) )
+		return 0;
+	if ( !key_sort_init(&ks, capacity) ) {
+		free(block);
+		return 0;
 	}
-	
-	p->depth = particle_depth(p);
-	p->lifespan--;
+	if ( !quad_stream_init(&qs, sizeof(smoke_vertex), capacity) ) {
+		key_sort_free(&ks);
+		free(block);
+		return 0;
+	}
+	if ( !grid_init(&grid, PARTICLE_SPACING, capacity) ) {
+		quad_stream_free(&qs);
+		key_sort_free(&ks);
+		free(block);
+		return 0;
+	}
+	memset(block, 0, (sizeof(float) * PARTICLE_ARRAYS + sizeof(int)) * slots);
+
+	live = particles.live < capacity ? particles.live : capacity;
+	for(i=0; i<PARTICLE_ARRAYS; i++) {
+		float *array = (float*)block + slots * i;
+
+		if ( live )
+			memcpy(array, *arrays[i], sizeof(float) * live);
+		*arrays[i] = array;
+	}
+	source = (int*)((float*)block + slots * PARTICLE_ARRAYS);
+	if ( live )
+		memcpy(source, particles.source, sizeof(int) * live);
+	particles.source = source;
+	free(particles.block);
+	particles.block = block;
+	particles.live = live;
+	particles.capacity = capacity;
+
+	key_sort_free(&order);
+	order = ks;
+	quad_stream_free(&smoke);
+	smoke = qs;
+	grid_free(&neighbors);
+	neighbors = grid;
+
+	particles_recount();
+	thruster_emitters();
+	if ( analytic_on && !ring_init(capacity) )
+		particles_set_analytic(0);
+	return 1;
 }
 
+/* counts each emitter's live particles again, after the pool has lost
+ * some */
+static void particles_recount(void) {
+	int i;
+
+	for(i=0; i<MAX_EMITTERS; i++)
+		emitters[i].live = 0;
+	for(i=0; i<particles.live; i++)
+		emitters[particles.source[i]].live++;
+}
+
+/* sets up the emitters at the back of the thrusters, each with half the
+ * pool.  The rate gives off a little more than the budget can hold over
+ * an average lifespan, so the pool stays full. */
+static void thruster_emitters(void) {
+	static const float offset[3] = { 0, 0, 0 };
+	static const float direction[3] = { 0, 0, -0.1 };
+	static const enum joint_label joint[2] = { SL_R_THRUSTER, SL_L_THRUSTER };
+	int budget, t;
+
+	budget = particles.capacity / 2;
+	for(t=0; t<2; t++) {
+		if ( thrusters[t] < 0 ) {
+			thrusters[t] = emitter_create();
+			if ( thrusters[t] < 0 )
+				continue;
+			emitter_attach(thrusters[t], joint[t], offset, direction);
+			emitter_set_color(thrusters[t], colors[sm_color]);
+		}
+		emitter_set_budget(thrusters[t], budget);
+		emitter_set_rate(thrusters[t], budget * 3.0 / MAX_LIFESPAN);
+	}
+}
+
+/* turns order independent transparency for the smoke on or off.  
+ * Returns whether it is on, which it won't be if GL can't do it. */
+int particles_set_oit(int on) {
+	oit_on = on && init_oit();
+	return oit_on;
+}
+
+/* whether the smoke uses order independent transparency */
+int particles_get_oit(void) {
+	return oit_on;
+}
+
+/* turns analytic mode on or off.  In analytic mode each particle is 
+ * only written once, when it is spawned, and the vertex shader moves 
+ * it; the CPU does nothing per particle per tick.  Either way the smoke
+ * starts again from nothing.  Returns whether it is on, which it won't
+ * be if GL has no shaders. */
+int particles_set_analytic(int on) {
+	int i;
+
+	if ( on && !analytic_program ) {
+		analytic_program = shader_program(analytic_vs, analytic_fs);
+		if ( !analytic_program )
+			on = 0;
+	}
+	if ( on && !ring_init(particles.capacity) )
+		on = 0;
+	if ( !on )
+		ring_free();
+	analytic_on = on;
+	if ( on )
+		volume_on = 0;
+
+	particles.live = 0;
+	for(i=0; i<MAX_EMITTERS; i++)
+		emitters[i].live = 0;
+	return analytic_on;
+}
+
+/* whether the smoke is in analytic mode */
+int particles_get_analytic(void) {
+	return analytic_on;
+}
+
+/* turns volumetric smoke on or off.  The emitters pour in to a grid 
+ * instead of giving off particles, and the cost is the grid's rather 
+ * than the particles'.  The budgets don't apply; the rates do.  Turning
+ * it on clears the old smoke.  Returns whether it is on, which it won't
+ * be if GL has no 3D textures. */
+int particles_set_volume(int on) {
+	if ( on && !init_volume() )
+		on = 0;
+	if ( on ) {
+		particles_set_analytic(0);
+		volume_clear();
+	}
+	volume_on = on;
+	return volume_on;
+}
+
+/* whether the smoke is volumetric */
+int particles_get_volume(void) {
+	return volume_on;
+}
+
+/* turns the turbulence on or off.  The particles are carried along a 
+ * baked curl noise field (see curl.c) as well as their own velocity.  
+ * It only moves the particles the CPU thinks about, so the analytic 
+ * smoke and the volume don't swirl.  Returns whether it is on, which it
+ * won't be if the field couldn't be baked. */
+int particles_set_turbulence(int on) {
+	turbulence_on = on && init_curl();
+	return turbulence_on;
+}
+
+/* whether the particles swirl */
+int particles_get_turbulence(void) {
+	return turbulence_on;
+}
+
+/* turns collision with the robot on or off.  Like the turbulence, it 
+ * only applies to the particles the CPU thinks about. */
+void particles_set_collide(int on) {
+	collide_on = on;
+}
+
+/* whether the particles are kept out of the robot */
+int particles_get_collide(void) {
+	return collide_on;
+}
+
+/* pours this tick's smoke from each emitter in to the volume */
+static void volume_spawn(void) {
+	emitter_t *e;
+	int id;
+
+	for(id=0; id<MAX_EMITTERS; id++) {
+		e = &emitters[id];
+		if ( e->used )
+			volume_inject(e->position, e->velocity, 
+				e->rate * quality * PARTICLE_PUFF);
+	}
+}
+
+/* (re)makes the analytic mode's ring with room for slots particles, all
+ * empty.  Returns 0 on failure. */
+static int ring_init(int slots) {
+	quad_stream qs;
+	analytic_vertex *vertices;
+	float *death;
+	int i;
+
+	if ( !quad_stream_init(&qs, sizeof(analytic_vertex), slots) )
+		return 0;
+	vertices = calloc((size_t)slots * 4, sizeof(analytic_vertex));
+	death = malloc(sizeof(float) * slots);
+	if ( !vertices || !death ) {
+		free(vertices);
+		free(death);
+		quad_stream_free(&qs);
+		return 0;
+	}
+	/* nothing has been born: the unborn slots are culled by the shader */
+	for(i=0; i<slots * 4; i++)
+		vertices[i].tex[2] = 1e30;
+	for(i=0; i<slots; i++)
+		death[i] = 0;
+
+	ring_free();
+	ring.stream = qs;
+	ring.vertices = vertices;
+	ring.death = death;
+	ring.slots = slots;
+	ring.head = 0;
+	ring.dirty_first = 0;
+	ring.dirty_count = slots;
+	memset(ring.dying, 0, sizeof(ring.dying));
+	for(i=0; i<MAX_EMITTERS; i++)
+		emitters[i].live = 0;
+	return 1;
+}
+
+/* frees the analytic mode's ring */
+static void ring_free(void) {
+	quad_stream_free(&ring.stream);
+	free(ring.vertices);
+	free(ring.death);
+	ring.vertices = NULL;
+	ring.death = NULL;
+	ring.slots = 0;
+}
+
+/* the number of particles, up to want, that can be spawned in to the 
+ * ring before a slot that is still alive would be written over */
+static int ring_room(int want) {
+	int n, slot;
+
+	for(n=0; n<want && n<ring.slots; n++) {
+		slot = (ring.head + n) % ring.slots;
+		if ( ring.death[slot] > particle_tick )
+			break;
+	}
+	return n;
+}
+
+/* spawns a particle at emitter e in to the next slot of the ring, using
+ * PARTICLE_RANDOMS random floats from rnd */
+static void ring_spawn(const emitter_t *e, const float *rnd) {
+	static const float corners[4][2] = { {-1, 1}, {-1, -1}, {1, -1}, {1, 1} };
+	analytic_vertex v;
+	int slot = ring.head;
+	int life, c;
+
+	life = (int)(rnd[5] * (MAX_LIFESPAN/3)) + MAX_LIFESPAN/3;
+	v.pos[0] = e->position[0] + rnd[0] * 0.30 - 0.15;
+	v.pos[1] = e->position[1] + rnd[1] * 0.30 - 0.15;
+	v.pos[2] = e->position[2];
+	v.vel[0] = e->velocity[0] + rnd[2] * 0.01 - 0.005;
+	v.vel[1] = e->velocity[1] + rnd[3] * 0.01 - 0.005;
+	v.vel[2] = e->velocity[2] + rnd[4] * 0.01 - 0.005;
+	v.tex[2] = particle_tick;
+	v.tex[3] = life;
+	for(c=0; c<3; c++)
+		v.color[c] = e->color[c] >= 1 ? 255 : 255 * e->color[c];
+	v.color[3] = 255;
+	for(c=0; c<4; c++) {
+		v.tex[0] = corners[c][0];
+		v.tex[1] = corners[c][1];
+		ring.vertices[slot * 4 + c] = v;
+	}
+
+	ring.death[slot] = particle_tick + life;
+	ring.dying[(particle_tick + life) % MAX_LIFESPAN][e - emitters]++;
+	ring.head = (slot + 1) % ring.slots;
+	if ( !ring.dirty_count )
+		ring.dirty_first = slot;
+	if ( ring.dirty_count < ring.slots )
+		ring.dirty_count++;
+}
+
+/* sends the slots written since the last frame to GL */
+static void ring_upload(void) {
+	int first = ring.dirty_first;
+	int count = ring.dirty_count;
+
+	if ( first + count > ring.slots ) {
+		quad_stream_write(&ring.stream, first, ring.slots - first, 
+			&ring.vertices[first * 4]);
+		count -= ring.slots - first;
+		first = 0;
+	}
+	if ( count )
+		quad_stream_write(&ring.stream, first, count, 
+			&ring.vertices[first * 4]);
+	ring.dirty_count = 0;
+}
+
+/* sets the quality level, from QUALITY_MIN to 1.  The emitters give off
+ * and keep alive that fraction of their particles, and to keep the look
+ * of the smoke the quads grow and thicken, so that there is about the 
+ * same amount of smoke on the screen, only coarser. */
+void particles_set_quality(float level) {
+	if ( level < QUALITY_MIN )
+		level = QUALITY_MIN;
+	if ( level > 1 )
+		level = 1;
+	quality = level;
+	quad_width = PARTICLE_WIDTH / sqrt(level);
+	quad_alpha = 0.5 / sqrt(level);
+	if ( quad_alpha > 1 )
+		quad_alpha = 1;
+}
+
+/* the number of particles the pool can hold */
+int particles_get_capacity(void) {
+	return particles.capacity;
+}
+
+/* spawns particle i at emitter e, using PARTICLE_RANDOMS random floats
+ * from rnd */
+static void particle_spawn(int i, const emitter_t *e, const float *rnd) {
+	particles.x[i] = e->position[0] + rnd[0] * 0.30 - 0.15;
+	particles.y[i] = e->position[1] + rnd[1] * 0.30 - 0.15;
+	particles.z[i] = e->position[2];
+	particles.vx[i] = e->velocity[0] + rnd[2] * 0.01 - 0.005;
+	particles.vy[i] = e->velocity[1] + rnd[3] * 0.01 - 0.005;
+	particles.vz[i] = e->velocity[2] + rnd[4] * 0.01 - 0.005;
+	particles.life[i] = (int)(rnd[5] * (MAX_LIFESPAN/3)) + MAX_LIFESPAN/3;
+	particles.source[i] = e - emitters;
+}
+
+/* bounces particle i off the floor, scattering it sideways.  This is the
+ * rare case, so the kernel leaves it to plain scalar code. */
+static void particle_bounce(int i, rng_t *rng) {
+	vec3d vel;
+
+	vel.y = particles.vy[i] * -0.1;
+	vel.x = particles.vx[i] + 2 * (rng_float(rng) * vel.y - 0.5 * vel.y);
+	vel.z = particles.vz[i] + 2 * (rng_float(rng) * vel.y - 0.5 * vel.y);
+	vel = normalize(vel);
+	particles.vx[i] = vel.x / 10.0;
+	particles.vy[i] = vel.y / 10.0;
+	particles.vz[i] = vel.z / 10.0;
+}
+
+/* the think kernels: integrate the lift, the position, the depth and 
+ * the lifespan of particles [start, end), a vector of particles at a 
+ * time.  start and end must be multiples of PARTICLE_LANES.  There is 
+ * one for each vector unit, all giving the same results bit for bit, and
+ * integrate points at the one in use (see particles_set_simd). */
+static void particles_integrate_c(int start, int end, rng_t *rng) {
+	int i;
+
+	for(i=start; i<end; i++) {
+		particles.vy[i] += PARTICLE_LIFT;
+		particles.x[i] += particles.vx[i];
+		particles.y[i] += particles.vy[i];
+		particles.z[i] += particles.vz[i];
+		/* summed in the same order as the vector kernels */
+		particles.depth[i] = 
+			(particles.x[i] * depth_row[0] + particles.y[i] * depth_row[1]) +
+			(particles.z[i] * depth_row[2] + depth_row[3]);
+		particles.life[i]--;
+		
+		if ( particles.y[i] < PARTICLE_FLOOR )
+			particle_bounce(i, rng);
+	}
+}
+
+#ifdef SIMD_X86
+SIMD_TARGET("sse2")
+static void particles_integrate_sse2(int start, int end, rng_t *rng) {
+	const __m128 lift = _mm_set1_ps(PARTICLE_LIFT);
+	const __m128 ground = _mm_set1_ps(PARTICLE_FLOOR);
+	const __m128 one = _mm_set1_ps(1);
+	const __m128 d0 = _mm_set1_ps(depth_row[0]);
+	const __m128 d1 = _mm_set1_ps(depth_row[1]);
+	const __m128 d2 = _mm_set1_ps(depth_row[2]);
+	const __m128 d3 = _mm_set1_ps(depth_row[3]);
+	int i, l, bounce;
+
+	for(i=start; i<end; i+=4) {
+		__m128 vy = _mm_add_ps(_mm_load_ps(&particles.vy[i]), lift);
+		__m128 x = _mm_add_ps(_mm_load_ps(&particles.x[i]), 
+			_mm_load_ps(&particles.vx[i]));
+		__m128 y = _mm_add_ps(_mm_load_ps(&particles.y[i]), vy);
+		__m128 z = _mm_add_ps(_mm_load_ps(&particles.z[i]), 
+			_mm_load_ps(&particles.vz[i]));
+		__m128 d = _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(x, d0), _mm_mul_ps(y, d1)),
+			_mm_add_ps(_mm_mul_ps(z, d2), d3));
+
+		_mm_store_ps(&particles.vy[i], vy);
+		_mm_store_ps(&particles.x[i], x);
+		_mm_store_ps(&particles.y[i], y);
+		_mm_store_ps(&particles.z[i], z);
+		_mm_store_ps(&particles.depth[i], d);
+		_mm_store_ps(&particles.life[i], 
+			_mm_sub_ps(_mm_load_ps(&particles.life[i]), one));
+
+		bounce = _mm_movemask_ps(_mm_cmplt_ps(y, ground));
+		for(l=0; bounce; l++, bounce >>= 1)
+			if ( bounce & 1 )
+				particle_bounce(i + l, rng);
+	}
+}
+
+SIMD_TARGET("avx")
+static void particles_integrate_avx(int start, int end, rng_t *rng) {
+	const __m256 lift = _mm256_set1_ps(PARTICLE_LIFT);
+	const __m256 ground = _mm256_set1_ps(PARTICLE_FLOOR);
+	const __m256 one = _mm256_set1_ps(1);
+	const __m256 d0 = _mm256_set1_ps(depth_row[0]);
+	const __m256 d1 = _mm256_set1_ps(depth_row[1]);
+	const __m256 d2 = _mm256_set1_ps(depth_row[2]);
+	const __m256 d3 = _mm256_set1_ps(depth_row[3]);
+	int i, l, bounce;
+
+	for(i=start; i<end; i+=8) {
+		__m256 vy = _mm256_add_ps(_mm256_load_ps(&particles.vy[i]), lift);
+		__m256 x = _mm256_add_ps(_mm256_load_ps(&particles.x[i]), 
+			_mm256_load_ps(&particles.vx[i]));
+		__m256 y = _mm256_add_ps(_mm256_load_ps(&particles.y[i]), vy);
+		__m256 z = _mm256_add_ps(_mm256_load_ps(&particles.z[i]), 
+			_mm256_load_ps(&particles.vz[i]));
+		__m256 d = _mm256_add_ps(
+			_mm256_add_ps(_mm256_mul_ps(x, d0), _mm256_mul_ps(y, d1)),
+			_mm256_add_ps(_mm256_mul_ps(z, d2), d3));
+
+		_mm256_store_ps(&particles.vy[i], vy);
+		_mm256_store_ps(&particles.x[i], x);
+		_mm256_store_ps(&particles.y[i], y);
+		_mm256_store_ps(&particles.z[i], z);
+		_mm256_store_ps(&particles.depth[i], d);
+		_mm256_store_ps(&particles.life[i], 
+			_mm256_sub_ps(_mm256_load_ps(&particles.life[i]), one));
+
+		bounce = _mm256_movemask_ps(_mm256_cmp_ps(y, ground, _CMP_LT_OQ));
+		for(l=0; bounce; l++, bounce >>= 1)
+			if ( bounce & 1 )
+				particle_bounce(i + l, rng);
+	}
+}
+#endif
+
+/* carries particles [start, end) along the turbulence field.  One 
+ * lookup per particle; it moves them without touching their velocity,
+ * so the swirl never builds up. */
+static void particles_swirl(int start, int end) {
+	float v[3];
+	int i;
+
+	for(i=start; i<end; i++) {
+		curl_sample(particles.x[i], particles.y[i], particles.z[i], v);
+		particles.x[i] += v[0] * PARTICLE_SWIRL;
+		particles.y[i] += v[1] * PARTICLE_SWIRL;
+		particles.z[i] += v[2] * PARTICLE_SWIRL;
+	}
+}
+
+/* sets the colour of the thrusters' smoke.  Other emitters keep their
+ * own. */
 void particle_color(enum smoke_color color) {
-	if ( color > sizeof(colors)/3 )
+	int t;
+
+	if ( color >= sizeof(colors)/sizeof(colors[0]) )
 		return;
 	sm_color = color;
+	for(t=0; t<2; t++)
+		emitter_set_color(thrusters[t], colors[color]);
 }
 
-void particles_think(void) {
-	vec4f tmp;
-	load_matrixes(matrix1, 0);
-	load_matrixes(matrix2, 1);
-
-	tmp.p.x = 0;
-	tmp.p.y = 0;
-	tmp.p.z = 0;
-	tmp.p.w = 1;
-	
-	p1 = m_mult(matrix1, tmp);
-	p2 = m_mult(matrix2, tmp);
-	tmp.p.z = -1;
-	v1 = m_mult(matrix1, tmp);
-	v2 = m_mult(matrix2, tmp);
-	VECTSUB(v1.p, v1.p, p1.p);
-	VECTSUB(v2.p, v2.p, p2.p);
-	
+/* thinks about one chunk of the live particles.  Run on the worker
+ * threads, so it must not touch GL. */
+static void particles_think_chunk(int n, void *arg) {
+	int start = n * PARTICLE_CHUNK;
+	int end = start + PARTICLE_CHUNK;
+	rng_t rng;
+
+	if ( arg ) arg = arg; /* shut up compiler */
+	if ( end > PARTICLE_ROUND(particles.live) )
+		end = PARTICLE_ROUND(particles.live);
+	rng_stream(&rng, rng_step_seed(particle_tick), n);
+	if ( turbulence_on )
+		particles_swirl(start, end < particles.live ? end : particles.live);
+	if ( collide_on )
+		collide_particles(particles.x, particles.y, particles.z, 
+			particles.vx, particles.vy, particles.vz, 
+			start, end < particles.live ? end : particles.live);
+	integrate(start, end, &rng);
+}
+
+/* pushes apart the particles that are too close together, for one chunk
+ * of the grid's entries.  The chunks go through the particles in the 
+ * grid's order, reading the grid's copy of the positions, so the 
+ * neighbours are read straight through memory, nearest cells first.  
+ * Only velocities are changed, and 
+ * each particle only changes its own, so the chunks can run in any 
+ * order at once.  Run on the worker threads. */
+static void particles_separate_chunk(int n, void *arg) {
+	const float reach = PARTICLE_SPACING * PARTICLE_SPACING;
+	/* d * (reach - d^2) peaks at 2 / (3 sqrt 3) * PARTICLE_SPACING^3; 
+	 * this scales the peak to PARTICLE_PUSH */
+	const float scale = PARTICLE_PUSH * 2.598076f / 
+		(PARTICLE_SPACING * reach);
+	grid_range cells[GRID_CELLS];
+	unsigned int start = n * PARTICLE_CHUNK;
+	unsigned int end = start + PARTICLE_CHUNK;
+	unsigned int k, e;
+	float x, y, z, dx, dy, dz, d2, push, fx, fy, fz;
+	int ncells, c, i, found;
+
+	if ( arg ) arg = arg; /* shut up compiler */
+	if ( end > (unsigned int)neighbors.count )
+		end = neighbors.count;
+	for(k=start; k<end; k++) {
+		x = neighbors.x[k];
+		y = neighbors.y[k];
+		z = neighbors.z[k];
+		fx = fy = fz = 0;
+		found = 0;
+		ncells = grid_cells(&neighbors, x, y, z, PARTICLE_SPACING, cells);
+		for(c=0; c<ncells && found<PARTICLE_NEIGHBORS; c++)
+			for(e=cells[c].start; e<cells[c].end; e++) {
+				dx = x - neighbors.x[e];
+				dy = y - neighbors.y[e];
+				dz = z - neighbors.z[e];
+				d2 = dx*dx + dy*dy + dz*dz;
+				if ( d2 >= reach || d2 == 0 )
+					continue;
+				/* falls off to nothing at PARTICLE_SPACING (and at 
+				 * 0, but then particles that close are rare), and 
+				 * needs no square root */
+				push = reach - d2;
+				fx += dx * push;
+				fy += dy * push;
+				fz += dz * push;
+				if ( ++found == PARTICLE_NEIGHBORS )
+					break;
+			}
+		if ( !found )
+			continue;
+		/* averaged, so a crowd pushes no harder than one close 
+		 * neighbour */
+		push = scale / found;
+		i = neighbors.entries[k];
+		particles.vx[i] += fx * push;
+		particles.vy[i] += fy * push;
+		particles.vz[i] += fz * push;
+	}
+}
+
+/* gives off this tick's particles from each emitter, as far as its 
+ * budget and the free slots allow.  The random numbers are made in 
+ * batches. */
+static void particles_spawn(void) {
+	float rnd[PARTICLE_SPAWN_BATCH * PARTICLE_RANDOMS];
+	emitter_t *e;
+	rng_t rng;
+	int want, budget, count, id, i;
+
+	rng_stream(&rng, rng_step_seed(particle_tick), RNG_PARTICLE_SPAWN);
+	for(id=0; id<MAX_EMITTERS; id++) {
+		e = &emitters[id];
+		if ( analytic_on ) {
+			e->live -= ring.dying[particle_tick % MAX_LIFESPAN][id];
+			ring.dying[particle_tick % MAX_LIFESPAN][id] = 0;
+		}
+		if ( !e->used )
+			continue;
+		e->owed += e->rate * quality;
+		want = (int)e->owed;
+		e->owed -= want;
+		budget = e->budget * quality + 0.5;
+		if ( e->budget && budget < 1 )
+			budget = 1;
+		if ( e->budget && want > budget - e->live )
+			want = budget - e->live;
+		if ( analytic_on )
+			want = ring_room(want);
+		else if ( want > particles.capacity - particles.live )
+			want = particles.capacity - particles.live;
+		while ( want > 0 ) {
+			count = want < PARTICLE_SPAWN_BATCH ? want : PARTICLE_SPAWN_BATCH;
+			rng_fill(&rng, rnd, count * PARTICLE_RANDOMS);
+			for(i=0; i<count; i++)
+				if ( analytic_on )
+					ring_spawn(e, &rnd[i * PARTICLE_RANDOMS]);
+				else
+					particle_spawn(particles.live++, e, 
+						&rnd[i * PARTICLE_RANDOMS]);
+			e->live += count;
+			want -= count;
+		}
+	}
+}
+
+/* moves the last live particle in to each dead particle's slot */
+static void particles_compact(void) {
+	float *arrays[PARTICLE_ARRAYS] = {
+		particles.x, particles.y, particles.z,
+		particles.vx, particles.vy, particles.vz,
+		particles.life, particles.depth
+	};
+	int i, a, last;
+
+	i = 0;
+	while ( i < particles.live ) {
+		if ( particles.life[i] > 0 ) {
+			i++;
+			continue;
+		}
+		emitters[particles.source[i]].live--;
+		last = --particles.live;
+		for(a=0; a<PARTICLE_ARRAYS; a++)
+			arrays[a][i] = arrays[a][last];
+		particles.source[i] = particles.source[last];
+	}
+}
+
+/* empties the smoke, whichever way it is being made */
+void particles_clear(void) {
 	int i;
-	for(i=0; i<PARTICLE_COUNT; i++) {
-		if ( particles[i].lifespan <= 0 ) 
-			particle_recycle(&particles[i]);
-		particle_think(&particles[i]);
+
+	particles.live = 0;
+	for(i=0; i<MAX_EMITTERS; i++) {
+		emitters[i].live = 0;
+		emitters[i].owed = 0;
+	}
+	if ( analytic_on && !ring_init(particles.capacity) )
+		particles_set_analytic(0);
+	if ( volume_on )
+		volume_clear();
+}
+
+/* starts the smoke again from nothing and runs it on ticks ticks at 
+ * once, with the robot held where it is, so the next frame shows smoke
+ * that has already settled.  Nothing is drawn or sent to GL until then;
+ * the ticks are the same as particles_think's, on the workers, so the 
+ * smoke comes out as it would have if it had been left to run. */
+void particles_prewarm(int ticks) {
+	particles_clear();
+	while ( ticks-- > 0 )
+		particles_think();
+}
+
+/* the smoke's part of a snapshot.  The live particles' arrays follow it,
+ * in the order particles_set_capacity lists them, then their sources. */
+typedef struct {
+	int32_t capacity;
+	int32_t live;
+	uint64_t tick;
+	int32_t color;
+	int32_t thrusters[2];
+	int32_t analytic;
+	int32_t volume;
+	int32_t turbulence;
+	int32_t collide;
+} particle_snapshot;
+
+/* writes the smoke, and the emitters it comes from, to a snapshot.  The
+ * analytic smoke lives in GL's buffers and isn't written, only that the
+ * smoke was analytic; the volume is written if the smoke is volumetric.*/
+void particles_save(snapshot_writer *w) {
+	float *arrays[PARTICLE_ARRAYS] = {
+		particles.x, particles.y, particles.z,
+		particles.vx, particles.vy, particles.vz,
+		particles.life, particles.depth
+	};
+	particle_snapshot p;
+	int i;
+
+	memset(&p, 0, sizeof(p));
+	p.capacity = particles.capacity;
+	p.live = particles.live;
+	p.tick = particle_tick;
+	p.color = sm_color;
+	p.thrusters[0] = thrusters[0];
+	p.thrusters[1] = thrusters[1];
+	p.analytic = analytic_on;
+	p.volume = volume_on;
+	p.turbulence = turbulence_on;
+	p.collide = collide_on;
+
+	emitters_save(w);
+	snapshot_begin(w, SNAP_PARTICLES);
+	snapshot_write(w, &p, sizeof(p));
+	for(i=0; i<PARTICLE_ARRAYS; i++)
+		snapshot_write(w, arrays[i], sizeof(float) * particles.live);
+	snapshot_write(w, particles.source, sizeof(int) * particles.live);
+	snapshot_end(w);
+	if ( volume_on )
+		volume_save(w);
+}
+
+/* finds the smoke in a snapshot: its header, then its arrays and 
+ * sources in saved.  Returns NULL if any of it, the emitters or the 
+ * volume is missing or damaged. */
+static const particle_snapshot *particles_find(const snapshot_t *s, 
+		const void **saved) {
+	const particle_snapshot *p;
+	const int *source;
+	snapshot_reader r;
+	int i;
+
+	if ( !snapshot_find(s, SNAP_PARTICLES, &r) )
+		return NULL;
+	p = snapshot_read(&r, sizeof(*p));
+	if ( !p || p->capacity < PARTICLE_MIN_COUNT || 
+			p->capacity > PARTICLE_MAX_COUNT || 
+			p->live < 0 || p->live > p->capacity || 
+			p->color < 0 || p->color >= (int)(sizeof(colors)/sizeof(colors[0])) ||
+			p->thrusters[0] < -1 || p->thrusters[0] >= MAX_EMITTERS ||
+			p->thrusters[1] < -1 || p->thrusters[1] >= MAX_EMITTERS )
+		return NULL;
+	for(i=0; i<PARTICLE_ARRAYS; i++)
+		if ( !(saved[i] = snapshot_read(&r, sizeof(float) * p->live)) )
+			return NULL;
+	source = saved[PARTICLE_ARRAYS] = snapshot_read(&r, sizeof(int) * p->live);
+	if ( !source )
+		return NULL;
+	for(i=0; i<p->live; i++)
+		if ( source[i] < 0 || source[i] >= MAX_EMITTERS )
+			return NULL;
+	if ( !emitters_check(s) || (p->volume && !volume_check(s)) )
+		return NULL;
+	return p;
+}
+
+/* checks the snapshot's smoke and emitters can be restored, without 
+ * restoring them.  Only running out of memory can stop 
+ * particles_restore after this. */
+int particles_check(const snapshot_t *s) {
+	const void *saved[PARTICLE_ARRAYS + 1];
+
+	return particles_find(s, saved) != NULL;
+}
+
+/* restores the smoke and the emitters from a snapshot, resizing the pool
+ * and switching modes to match.  Analytic smoke starts again from 
+ * nothing.  Must be called from the GL thread.  Returns 0 if the 
+ * snapshot's smoke is damaged or the pool can't be resized; nothing has
+ * been changed then. */
+int particles_restore(const snapshot_t *s) {
+	float **arrays[PARTICLE_ARRAYS] = {
+		&particles.x, &particles.y, &particles.z,
+		&particles.vx, &particles.vy, &particles.vz,
+		&particles.life, &particles.depth
+	};
+	const void *saved[PARTICLE_ARRAYS + 1];
+	const particle_snapshot *p;
+	const int *source;
+	int i;
+
+	if ( !(p = particles_find(s, saved)) )
+		return 0;
+	source = saved[PARTICLE_ARRAYS];
+
+	if ( p->capacity != particles.capacity && 
+			!particles_set_capacity(p->capacity) )
+		return 0;
+	particles_set_analytic(p->analytic);
+	particles_set_volume(p->volume);
+	particles_set_turbulence(p->turbulence);
+	collide_on = p->collide;
+	if ( !emitters_restore(s) )
+		return 0;
+	thrusters[0] = p->thrusters[0];
+	thrusters[1] = p->thrusters[1];
+	sm_color = p->color;
+	particle_tick = p->tick;
+
+	particles.live = 0;
+	if ( !analytic_on && !volume_on ) {
+		for(i=0; i<PARTICLE_ARRAYS; i++)
+			memcpy(*arrays[i], saved[i], sizeof(float) * p->live);
+		memcpy(particles.source, source, sizeof(int) * p->live);
+		particles.live = p->live;
+	}
+	particles_recount();
+	if ( volume_on && !volume_restore(s) )
+		return 0;
+	return 1;
+}
+
+/* moves the smoke on a tick.  The emitters follow the joint matrixes, so
+ * kinematics_think must have been run for this tick first. */
+void particles_think(void) {
+	emitters_think();
+	if ( volume_on ) {
+		volume_spawn();
+		volume_think(PARTICLE_LIFT, PARTICLE_FLOOR);
+		particle_tick++;
+		return;
+	}
+	particles_spawn();
+	if ( analytic_on ) {
+		particle_tick++;
+		return;
 	}
+	if ( collide_on )
+		collide_think();
+	workers_run((PARTICLE_ROUND(particles.live) + PARTICLE_CHUNK - 1) / 
+		PARTICLE_CHUNK, particles_think_chunk, NULL);
+	grid_build(&neighbors, particles.x, particles.y, particles.z, 
+		particles.live);
+	workers_run((particles.live + PARTICLE_CHUNK - 1) / PARTICLE_CHUNK, 
+		particles_separate_chunk, NULL);
+	particles_compact();
+	particle_tick++;
 }
@@ -18,6 +18,16 @@
  *************************************************************************/
 
 #include "vector.h"
+#include "cpu.h"
+#include "snapshot.h"
+
+/* the pool size to start with, lit and (for slow machines) unlit */
+#define PARTICLE_DEFAULT_COUNT 4000
+#define PARTICLE_LITE_COUNT 512
+
+/* enough ticks for the smoke to settle from nothing: longer than any 
+ * particle lives */
+#define PARTICLE_SETTLE_TICKS 200
 
 enum smoke_color {
 	SM_WHITE,
@@ -30,18 +40,29 @@ enum smoke_color {
 	SM_GREEN
 };
 
-typedef struct {
-	vec4fp pos;
-	vec3d vel;
-	int lifespan;
-	double depth;
-} particle_t;
-
-void particles_render(void);
-void particle_recycle(particle_t *p);
-void particle_think(particle_t *p);
+void particles_render(float alpha);
 void particles_think(void);
+void particles_clear(void);
+void particles_prewarm(int ticks);
+void particles_save(snapshot_writer *w);
+int particles_check(const snapshot_t *s);
+int particles_restore(const snapshot_t *s);
 void init_particles(void);
+int particles_set_capacity(int capacity);
+int particles_get_capacity(void);
+int particles_set_oit(int on);
+int particles_get_oit(void);
+int particles_set_analytic(int on);
+int particles_get_analytic(void);
+int particles_set_volume(int on);
+int particles_get_volume(void);
+int particles_set_turbulence(int on);
+int particles_get_turbulence(void);
+void particles_set_collide(int on);
+int particles_get_collide(void);
+void particles_set_quality(float level);
+enum simd_level particles_set_simd(enum simd_level level);
+enum simd_level particles_get_simd(void);
+void particles_set_lit(int on);
+int particles_get_lit(void);
 void particle_color(enum smoke_color color);
-
-vec4f m_mult(float *m, vec4f v);
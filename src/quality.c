@@ -0,0 +1,129 @@
+/************************************************************************** 
+ * Nanobot:  A simple, interactive robot rendered using OpenGL
+ * Copyright (C) 2007, Corey Edmunds (corey.edmunds@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *************************************************************************/
+
+
+/**************************************************************************
+ * quality.c/h
+ *
+ * Holds the smoke to a time budget.  The time spent thinking about and
+ * drawing the particles is measured every tick and smoothed: the 
+ * tick's think, plus what one draw costs on average however many times
+ * the smoke is drawn in it.  The quality level (1 is full quality) is 
+ * stepped down while it is over budget and crept back up while it is 
+ * well under.  The particle system turns the level in to fewer, larger,
+ * more opaque particles.
+ *
+ * Only CPU time is seen; GL works asynchronously, so the fill cost of 
+ * the smoke shows up here only as far as the driver makes us wait.  That
+ * is most of it on a software renderer, which is where it matters.
+ *************************************************************************/
+#include "quality.h"
+#include <time.h>
+
+/* how much of each new tick goes in to the smoothed cost */
+#define QUALITY_SMOOTHING 0.1
+/* the level steps down when over budget, and up more slowly when the
+ * cost is under QUALITY_HEADROOM of it, so it settles rather than 
+ * hunting back and forth.  Smoke already alive can't be taken back, only
+ * left to die, which takes about 1% of it a tick; stepping down any 
+ * faster than that just overshoots. */
+#define QUALITY_DOWN 0.99
+#define QUALITY_UP 1.005
+#define QUALITY_HEADROOM 0.75
+
+/* the budget in milliseconds, 0 if the controller is off */
+static double budget = 0;
+/* the time spent thinking so far this tick, drawing so far this tick 
+ * and the draws it took, and the smoothed cost per tick */
+static double spent = 0;
+static double drawn = 0;
+static int draws = 0;
+static double cost = 0;
+/* when the current measurement started */
+static double started;
+static float level = 1;
+
+/* the time in milliseconds */
+static double now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/* sets the budget for the smoke, in milliseconds per tick.  0 turns 
+ * the controller off and leaves the smoke at full quality. */
+void init_quality(double ms) {
+	budget = ms > 0 ? ms : 0;
+	spent = 0;
+	drawn = 0;
+	draws = 0;
+	cost = 0;
+	level = 1;
+}
+
+/* starts timing some smoke work */
+void quality_start(void) {
+	started = now();
+}
+
+/* stops timing some smoke work, adding it to this tick's cost */
+void quality_stop(void) {
+	spent += now() - started;
+}
+
+/* stops timing a draw of the smoke.  However many times the smoke is 
+ * drawn in a tick, only what one draw costs counts towards it. */
+void quality_stop_draw(void) {
+	drawn += now() - started;
+	draws++;
+}
+
+/* ends a tick (a frame, as ROBOT_MS_PER_FRAME has it), and returns 
+ * the quality level to use for the next one */
+float quality_frame(void) {
+	if ( draws )
+		spent += drawn / draws;
+	cost += (spent - cost) * QUALITY_SMOOTHING;
+	spent = 0;
+	drawn = 0;
+	draws = 0;
+	if ( !budget )
+		return level;
+
+	if ( cost > budget )
+		level *= QUALITY_DOWN;
+	else if ( cost < budget * QUALITY_HEADROOM )
+		level *= QUALITY_UP;
+	if ( level > 1 )
+		level = 1;
+	if ( level < QUALITY_MIN )
+		level = QUALITY_MIN;
+	return level;
+}
+
+/* the current quality level */
+float quality_level(void) {
+	return level;
+}
+
+/* the smoothed cost of the smoke, in milliseconds per tick */
+double quality_cost(void) {
+	return cost;
+}
@@ -0,0 +1,47 @@
+/************************************************************************** 
+ * Nanobot:  A simple, interactive robot rendered using OpenGL
+ * Copyright (C) 2007, Corey Edmunds (corey.edmunds@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *************************************************************************/
+
+
+/**************************************************************************
+ * quality.c/h
+ *
+ * Holds the smoke to a time budget.  The time spent thinking about and
+ * drawing the particles is measured every tick and smoothed: the 
+ * tick's think, plus what one draw costs on average however many times
+ * the smoke is drawn in it.  The quality level (1 is full quality) is 
+ * stepped down while it is over budget and crept back up while it is 
+ * well under.  The particle system turns the level in to fewer, larger,
+ * more opaque particles.
+ *************************************************************************/
+#ifndef __QUALITY_H
+#define __QUALITY_H
+
+/* the default budget for the smoke, in milliseconds per tick */
+#define QUALITY_DEFAULT_BUDGET 4.0
+/* the lowest the quality level goes */
+#define QUALITY_MIN (1.0 / 16.0)
+
+void init_quality(double budget);
+void quality_start(void);
+void quality_stop(void);
+void quality_stop_draw(void);
+float quality_frame(void);
+float quality_level(void);
+double quality_cost(void);
+#endif
@@ -21,9 +21,11 @@
  * render.c/h
  *
  * This file contains all of the routines responsible for rendering 
- * nanobot.  The routines only contain positioning (rotate/translate),
- * labelling, picking code.  Display lists are called to draw things; 
- * nothing in here is drawn directly.
+ * nanobot.  The routines only contain positioning, labelling, picking 
+ * code.  Each part is placed by its joint's matrix from kinematics.c,
+ * plus whatever turns the joint makes between the part's pieces.  
+ * Display lists are called to draw things; nothing in here is drawn 
+ * directly.
  *************************************************************************/
 #include <GL/gl.h>
 #include <GL/glut.h>
@@ -31,6 +33,7 @@
 #include "draw.h"
 #include "render.h"
 #include "joint.h"
+#include "kinematics.h"
 
 /* toggles wireframe mode on/off for an object that may be selected */
 void set_wire(enum joint_label joint, int on) {
@@ -57,14 +60,28 @@ void set_wire(enum joint_label joint, int on) {
 	}
 }
 
+/* joint's angles as it is drawn, between two ticks, to agree with its
+ * matrix.  X_ROT and Y_ROT are the latest tick's. */
+#define DRAWN_X(j) (joint_drawn_angles(j)[AXIS_X])
+#define DRAWN_Y(j) (joint_drawn_angles(j)[AXIS_Y])
+
+/* multiplies joint's matrix (or, for base, where it turns) in to the 
+ * modelview.  Push first. */
+static void joint_load(enum joint_label joint, int base) {
+	glMultMatrixf(joint_drawn(joint, base));
+}
+
 void render_l_solar_panel(void) {
 	glLoadName(SL_L_SOLARPANEL);
 	
 	set_wire(SL_L_SOLARPANEL, 1);
 	glPushMatrix();
-		glRotatef(X_ROT(SL_L_SOLARPANEL), 0, 1, 0);
+		joint_load(SL_L_SOLARPANEL, 1);
+		glRotatef(DRAWN_X(SL_L_SOLARPANEL), 0, 1, 0);
 		glCallList(DL_SOLARPANEL_STICK);
-		glRotatef(Y_ROT(SL_L_SOLARPANEL), 0, 0, 1);
+	glPopMatrix();
+	glPushMatrix();
+		joint_load(SL_L_SOLARPANEL, 0);
 		glCallList(DL_SOLARPANEL);
 	glPopMatrix();
 	set_wire(SL_L_SOLARPANEL, 0);
@@ -74,9 +91,12 @@ void render_r_solar_panel(void) {
 	glLoadName(SL_R_SOLARPANEL);
 	set_wire(SL_R_SOLARPANEL, 1);
 	glPushMatrix();
-		glRotatef(X_ROT(SL_R_SOLARPANEL), 0, 1, 0);
+		joint_load(SL_R_SOLARPANEL, 1);
+		glRotatef(DRAWN_X(SL_R_SOLARPANEL), 0, 1, 0);
 		glCallList(DL_SOLARPANEL_STICK);
-		glRotatef(Y_ROT(SL_R_SOLARPANEL), 0, 0, 1);
+	glPopMatrix();
+	glPushMatrix();
+		joint_load(SL_R_SOLARPANEL, 0);
 		glCallList(DL_SOLARPANEL);
 	glPopMatrix();
 	set_wire(SL_R_SOLARPANEL, 0);
@@ -88,47 +108,53 @@ void render_headlights(void) {
 	
 	glLoadName(SL_HEADLIGHTS);
 	set_wire(SL_HEADLIGHTS, 1);
-	/* yeah so the coordinates are all translated here...*/
-	glRotatef(X_ROT(SL_HEADLIGHTS), 0, 1, 0);
-	glCallList(DL_HEADLIGHT_STICK);
-	glTranslatef(-0.1, 0, -0.025);
-	/* yeah so the coordinates are all translated here...*/
-	glRotatef(Y_ROT(SL_HEADLIGHTS), 1, 0, 0);
-	glCallList(DL_HEADLIGHT);
-	glLightfv(GL_LIGHT1, GL_POSITION, position);
-	glLightfv(GL_LIGHT1, GL_SPOT_DIRECTION, direction);
-	glTranslatef(0.2, 0, 0);
-	glCallList(DL_HEADLIGHT);
-	glLightfv(GL_LIGHT2, GL_POSITION, position);
-	glLightfv(GL_LIGHT2, GL_SPOT_DIRECTION, direction);
+	glPushMatrix();
+		joint_load(SL_HEADLIGHTS, 1);
+		glRotatef(DRAWN_X(SL_HEADLIGHTS), 0, 1, 0);
+		glCallList(DL_HEADLIGHT_STICK);
+	glPopMatrix();
+	glPushMatrix();
+		joint_load(SL_HEADLIGHTS, 0);
+		glCallList(DL_HEADLIGHT);
+		glLightfv(GL_LIGHT1, GL_POSITION, position);
+		glLightfv(GL_LIGHT1, GL_SPOT_DIRECTION, direction);
+		glTranslatef(0.2, 0, 0);
+		glCallList(DL_HEADLIGHT);
+		glLightfv(GL_LIGHT2, GL_POSITION, position);
+		glLightfv(GL_LIGHT2, GL_SPOT_DIRECTION, direction);
+	glPopMatrix();
 	set_wire(SL_HEADLIGHTS, 0);
 }
 
 void render_camera(void) {
 	glLoadName(SL_CAMERA);
 	set_wire(SL_CAMERA, 1);
-	glRotatef(X_ROT(SL_CAMERA), 0, 1, 0);
-	glRotatef(Y_ROT(SL_CAMERA), 1, 0, 0);
-	glCallList(DL_CAMERA);
+	glPushMatrix();
+		joint_load(SL_CAMERA, 0);
+		glCallList(DL_CAMERA);
+	glPopMatrix();
 	set_wire(SL_CAMERA, 0);
 }
 
 void render_fingers(int id) {
 	glLoadName(SL_L_FINGERS + id);
 	set_wire(SL_L_FINGERS + id, 1);
-	glRotatef(X_ROT(SL_L_FINGERS + id)/2, 1, 0, 0);
-	glCallList(DL_FINGERS);
-	glRotatef(-X_ROT(SL_L_FINGERS + id), 1, 0, 0);
-	glCallList(DL_THUMB);
+	glPushMatrix();
+		joint_load(SL_L_FINGERS + id, 0);
+		glCallList(DL_FINGERS);
+		glRotatef(-DRAWN_X(SL_L_FINGERS + id), 1, 0, 0);
+		glCallList(DL_THUMB);
+	glPopMatrix();
 	set_wire(SL_R_FINGERS + id, 0);
 }
 
 void render_hand(int id) {
 	glLoadName(SL_L_WRIST + id);
 	set_wire(SL_L_WRIST + id, 1);
-	glRotatef(X_ROT(SL_L_WRIST + id), 0, 1, 0);
-	glRotatef(Y_ROT(SL_L_WRIST + id), 1, 0, 0);
-	glCallList(DL_HAND);
+	glPushMatrix();
+		joint_load(SL_L_WRIST + id, 0);
+		glCallList(DL_HAND);
+	glPopMatrix();
 	set_wire(SL_L_WRIST + id, 0);
 	render_fingers(id);
 }
@@ -136,9 +162,14 @@ void render_hand(int id) {
 void render_forearm(int id) {
 	glLoadName(SL_L_FOREARM + id);
 	set_wire(SL_L_FOREARM + id, 1);
-	glCallList(DL_ELBOW);
-	glRotatef(Y_ROT(SL_L_FOREARM + id), 0, 1, 0);
-	glCallList(DL_FOREARM);
+	glPushMatrix();
+		joint_load(SL_L_FOREARM + id, 1);
+		glCallList(DL_ELBOW);
+	glPopMatrix();
+	glPushMatrix();
+		joint_load(SL_L_FOREARM + id, 0);
+		glCallList(DL_FOREARM);
+	glPopMatrix();
 	set_wire(SL_L_FOREARM + id, 0);
 	render_hand(id);
 }
@@ -146,10 +177,15 @@ void render_forearm(int id) {
 void render_shoulder(int id) {
 	glLoadName(SL_L_UPPERARM + id);
 	set_wire(SL_L_UPPERARM + id, 1);
-	glRotatef(Y_ROT(SL_L_UPPERARM + id), 0, 0, 1);
-	glCallList(DL_SHOULDER);
-	glRotatef(X_ROT(SL_L_UPPERARM + id), 1, 0, 0);
-	glCallList(DL_UPPERARM);
+	glPushMatrix();
+		joint_load(SL_L_UPPERARM + id, 1);
+		glRotatef(DRAWN_Y(SL_L_UPPERARM + id), 0, 0, 1);
+		glCallList(DL_SHOULDER);
+	glPopMatrix();
+	glPushMatrix();
+		joint_load(SL_L_UPPERARM + id, 0);
+		glCallList(DL_UPPERARM);
+	glPopMatrix();
 	set_wire(SL_L_UPPERARM + id, 0);
 	render_forearm(id);
 }
@@ -158,21 +194,22 @@ void render_toes(int id) {
 	glLoadName(SL_L_TOES+id);
 	set_wire(SL_L_TOES+id, 1);
 	glPushMatrix();
-		glRotatef(32, 0, 1, 0);
-		glTranslatef(0, 0, 0.35);
-		glRotatef(Y_ROT(SL_L_TOES+id), 1, 0, 0);
-		glCallList(DL_TOE);
-	glPopMatrix();
-	glPushMatrix();
-		glRotatef(-32, 0, 1, 0);
-		glTranslatef(0, 0, 0.35);
-		glRotatef(Y_ROT(SL_L_TOES+id), 1, 0, 0);
-		glCallList(DL_TOE);
-	glPopMatrix();
-	glPushMatrix();
+		joint_load(SL_L_TOES+id, 0);
+		glPushMatrix();
+			glRotatef(32, 0, 1, 0);
+			glTranslatef(0, 0, 0.35);
+			glRotatef(DRAWN_Y(SL_L_TOES+id), 1, 0, 0);
+			glCallList(DL_TOE);
+		glPopMatrix();
+		glPushMatrix();
+			glRotatef(-32, 0, 1, 0);
+			glTranslatef(0, 0, 0.35);
+			glRotatef(DRAWN_Y(SL_L_TOES+id), 1, 0, 0);
+			glCallList(DL_TOE);
+		glPopMatrix();
 		glRotatef(180, 0, 1, 0);
 		glTranslatef(0, 0, 0.35);
-		glRotatef(Y_ROT(SL_L_TOES+id), 1, 0, 0);
+		glRotatef(DRAWN_Y(SL_L_TOES+id), 1, 0, 0);
 		glCallList(DL_TOE);
 	glPopMatrix();
 	set_wire(SL_L_TOES+id, 0);
@@ -181,9 +218,10 @@ void render_toes(int id) {
 void render_foot(int id) {
 	glLoadName(SL_L_FOOT+id);
 	set_wire(SL_L_FOOT+id, 1);
-	glRotatef(Y_ROT(SL_L_FOOT+id), 1, 0, 0);
-	glRotatef(X_ROT(SL_L_FOOT+id), 0, 1, 0);
-	glCallList(DL_FOOT);
+	glPushMatrix();
+		joint_load(SL_L_FOOT+id, 0);
+		glCallList(DL_FOOT);
+	glPopMatrix();
 	set_wire(SL_L_FOOT+id, 0);
 	render_toes(id);
 }
@@ -191,153 +229,82 @@ void render_foot(int id) {
 void render_lower_leg(int id) {
 	glLoadName(SL_L_LOWERLEG+id);
 	set_wire(SL_L_LOWERLEG+id, 1);
-	glRotatef(Y_ROT(SL_L_LOWERLEG+id), 1, 0, 0);
-	glCallList(DL_LOWERLEG);
+	glPushMatrix();
+		joint_load(SL_L_LOWERLEG+id, 0);
+		glCallList(DL_LOWERLEG);
+	glPopMatrix();
 	set_wire(SL_L_LOWERLEG+id, 0);
 	render_foot(id);
 }
 
 void render_r_upper_leg(void) {
-	//glTranslatef(0.025, -0.15, 1);
-	glRotatef(X_ROT(SL_R_UPPERLEG), 0, 1, 0);
-	glRotatef(Y_ROT(SL_R_UPPERLEG), 1, 0, 0);
-	glTranslatef(0.025, -0.30, 0);
 	glLoadName(SL_R_UPPERLEG);
 	set_wire(SL_R_UPPERLEG, 1);
-	glCallList(DL_UPPERLEG);
+	glPushMatrix();
+		joint_load(SL_R_UPPERLEG, 0);
+		glCallList(DL_UPPERLEG);
+	glPopMatrix();
 	set_wire(SL_R_UPPERLEG, 0);
 	render_lower_leg(1);
 }
 
 void render_l_upper_leg(void) {
-	//glTranslatef(0.025, -0.15, 1);
-	glRotatef(X_ROT(SL_L_UPPERLEG), 0, 1, 0);
-	glRotatef(Y_ROT(SL_L_UPPERLEG), 1, 0, 0);
-	glTranslatef(-0.025, -0.30, 0);
 	glLoadName(SL_L_UPPERLEG);
 	set_wire(SL_L_UPPERLEG, 1);
-	glRotatef(180, 0, 1, 0);
-	glCallList(DL_UPPERLEG);
-	glRotatef(-180, 0, 1, 0);
+	glPushMatrix();
+		joint_load(SL_L_UPPERLEG, 0);
+		/* the left upper leg is the right one turned round */
+		glRotatef(180, 0, 1, 0);
+		glCallList(DL_UPPERLEG);
+	glPopMatrix();
 	set_wire(SL_L_UPPERLEG, 0);
-	/* the following undoes a translation that is present in the
-	 * display list.  It moves the origin to the axis of the knee. */
-	glTranslatef(0, 0, -0.27); 
 	render_lower_leg(0);
 }
 
+/* draws the robot.  Each part is drawn from its joint's matrix (see 
+ * kinematics.c), so the modelview is left as it was, and kinematics_think
+ * must have been run since the joints last moved. */
 void render_body(void) {
-	/* the body is drawn last to make selection more usable, however,
-	 * the rotations have to be applied first because everything is
-	 * attached to the body... */
-	glRotatef(X_ROT(SL_BODY), 0, 1, 0);
-	glRotatef(Y_ROT(SL_BODY), 1, 0, 0);
-	glRotatef(Z_ROT(SL_BODY), 0, 0, 1);
-	
+	/* the body is drawn last to make selection more usable */
 	render_turbines();
-
-	glPushMatrix();
-		glTranslatef(0,0.75,0.50);
-		render_headlights();
-	glPopMatrix();
-
-	glPushMatrix();
-		glTranslatef(0.2,0.75,-0.30);
-		glRotatef(90, 0, 1, 0);
-		render_l_solar_panel();
-		glRotatef(-90, 0, 1, 0);
-		glTranslatef(-0.4, 0, 0);
-		glRotatef(-90, 0, 1, 0);
-		render_r_solar_panel();
-	glPopMatrix();
-
-	glPushMatrix();
-		glRotatef(-25, 1, 0, 0);
-		glTranslatef(0, 0, 1);
-		render_camera();
-	glPopMatrix();
-		
-	glPushMatrix();
-		glRotatef(90, 0, 1, 0);
-		glTranslatef(0, 0, 1.0);
-		render_shoulder(0);
-	glPopMatrix();	
-
-	glPushMatrix();
-		glRotatef(-90, 0, 1, 0);
-		glTranslatef(0, 0, 1.0);
-		render_shoulder(1);
-	glPopMatrix();	
-
-	glPushMatrix();
-		glRotatef(-50, 0, 0, 1);
-		glTranslatef(1.0, 0, 0);
-		glRotatef(50, 0, 0, 1);
-		render_r_upper_leg();
-	glPopMatrix();
-	
-	glPushMatrix();
-		glRotatef(-180+50, 0, 0, 1);
-		glTranslatef(1.0, 0, 0);
-		glRotatef(180-50, 0, 0, 1);
-		render_l_upper_leg();
-	glPopMatrix();
+	render_headlights();
+	render_l_solar_panel();
+	render_r_solar_panel();
+	render_camera();
+	render_shoulder(0);
+	render_shoulder(1);
+	render_r_upper_leg();
+	render_l_upper_leg();
 
 	glLoadName(SL_BODY);
 	set_wire(SL_BODY, 1);
-	glCallList(DL_BODY);	
+	glPushMatrix();
+		joint_load(SL_BODY, 0);
+		glCallList(DL_BODY);	
+	glPopMatrix();
 	set_wire(SL_BODY, 0);
 	
 	glLoadName(-12315435);
 }
 
-/* this is gross.  Renders the turbines so they spin about an axis that runs
-   through one of the pylons.  The translations mimic the pylon positioning. */
+/* renders the turbines, spinning about the thrusters' axes */
 void render_turbines(void) {
-	extern int anim_seq;
+	extern float anim_time;
 	glLoadName(SL_L_THRUSTER);
 	set_wire(SL_L_THRUSTER, 1);
 	glPushMatrix();
-		/* translate out to pylon sphere position */
-		glRotatef(90, 0, 1, 0);
-		glRotatef(-40, 1, 0, 0);
-		glTranslatef(0, 0, 0.90);
-		/* rotate to the thruster attachment angle */
-		glRotatef(10, 1, 0, 0);
-		/* translate thruster out */
-		glTranslatef(0, 0, 0.55);
-		/* apply animation/rotation to thruster */
-		glRotatef(Y_ROT(SL_L_THRUSTER), 0, 0, 1);
-		/* unrotate the thruster so the back end looks straight */
-		glRotatef(30, 1, 0, 0);
-		/* flip thruster around so it points the right way */
-		glRotatef(180, 0, 0, 1);
-		/* flip the thruster 90 degrees so it points the right way */
-		glRotatef(90, 0, 1, 0);
+		joint_load(SL_L_THRUSTER, 0);
 		glCallList(DL_THRUSTER);
-		glRotatef(anim_seq * 4, 0, 0, 1);
+		glRotatef(anim_time * 4, 0, 0, 1);
 		glCallList(DL_TURBINE);
 	glPopMatrix();
 	set_wire(SL_L_THRUSTER, 0);
 	glLoadName(SL_R_THRUSTER);
 	set_wire(SL_R_THRUSTER, 1);
 	glPushMatrix();
-		/* translate out to pylon sphere position */
-		glRotatef(-90, 0, 1, 0);
-		glRotatef(-40, 1, 0, 0);
-		glTranslatef(0, 0, 0.90);
-		/* rotate to the thruster attachment angle */
-		glRotatef(10, 1, 0, 0);
-		/* translate thruster out */
-		glTranslatef(0, 0, 0.55);
-		/* apply animation/rotation to thruster */
-		glRotatef(-Y_ROT(SL_R_THRUSTER), 0, 0, 1);
-		/* unrotate the thruster so the back end looks straight */
-		glRotatef(30, 1, 0, 0);
-		/* flip the thruster 90 degrees so it points the right way */
-		glRotatef(90, 0, 1, 0);
+		joint_load(SL_R_THRUSTER, 0);
 		glCallList(DL_THRUSTER);
-		glRotatef(anim_seq * 4, 0, 0, 1);
+		glRotatef(anim_time * 4, 0, 0, 1);
 		glCallList(DL_TURBINE);
 	glPopMatrix();
 	set_wire(SL_R_THRUSTER, 0);
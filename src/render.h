@@ -22,9 +22,11 @@
  * render.c/h
  *
  * This file contains all of the routines responsible for rendering 
- * nanobot.  The routines only contain positioning (rotate/translate),
- * labelling, picking code.  Display lists are called to draw things; 
- * nothing in here is drawn directly.
+ * nanobot.  The routines only contain positioning, labelling, picking 
+ * code.  Each part is placed by its joint's matrix from kinematics.c,
+ * plus whatever turns the joint makes between the part's pieces.  
+ * Display lists are called to draw things; nothing in here is drawn 
+ * directly.
  *************************************************************************/
 #ifndef __RENDER_H
 #define __RENDER_H
@@ -0,0 +1,152 @@
+/************************************************************************** 
+ * Nanobot:  A simple, interactive robot rendered using OpenGL
+ * Copyright (C) 2007, Corey Edmunds (corey.edmunds@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *************************************************************************/
+
+
+/**************************************************************************
+ * rng.c/h
+ *
+ * A counter based random number generator.  A stream is a key and a
+ * counter, and each number is a hash of the two, so streams never share
+ * state.  Work split in to chunks can give each chunk its own stream and
+ * get the same numbers no matter which thread runs it.
+ *
+ * Every stream is derived from one program wide seed (--seed), so runs 
+ * with the same seed are repeatable bit for bit.  The hash only uses 32 
+ * bit integer operations and numbers do not depend on each other, so 
+ * rng_fill() generates them a vector at a time.
+ *************************************************************************/
+#include "rng.h"
+#ifdef __SSE2__
+	#include <emmintrin.h>
+#endif
+#ifdef __SSE4_1__
+	#include <smmintrin.h>
+#endif
+
+/* the program wide seed */
+static uint64_t seed_all = 1;
+
+/* the splitmix64 finalizer -- a cheap, well mixed 64 bit hash.  Only
+ * used to set streams up. */
+static uint64_t rng_mix(uint64_t z) {
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+/* a well mixed 32 bit hash (Wellons' lowbias32) */
+static inline uint32_t rng_hash(uint32_t x) {
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+/* the number at counter c of the stream with the given key */
+static inline uint32_t rng_at(uint64_t key, uint32_t c) {
+	return rng_hash(rng_hash(c + (uint32_t)key) ^ (uint32_t)(key >> 32));
+}
+
+#ifdef __SSE2__
+/* a 32 bit multiply of each lane.  SSE2 only has the 32x32->64 bit
+ * multiply of the even lanes, so the odd lanes are shifted down for it. */
+static inline __m128i rng_mullo(__m128i a, __m128i b) {
+#ifdef __SSE4_1__
+	return _mm_mullo_epi32(a, b);
+#else
+	__m128i even = _mm_mul_epu32(a, b);
+	__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+	return _mm_unpacklo_epi32(
+		_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+		_mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+#endif
+}
+
+/* rng_hash() on 4 lanes */
+static inline __m128i rng_hash4(__m128i x) {
+	x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+	x = rng_mullo(x, _mm_set1_epi32(0x7feb352d));
+	x = _mm_xor_si128(x, _mm_srli_epi32(x, 15));
+	x = rng_mullo(x, _mm_set1_epi32(0x846ca68b));
+	x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+	return x;
+}
+#endif
+
+/* sets the program wide seed.  Streams started afterwards use it. */
+void rng_seed(uint64_t seed) {
+	seed_all = seed;
+}
+
+/* the program wide seed */
+uint64_t rng_get_seed(void) {
+	return seed_all;
+}
+
+/* the seed for the streams of step t of something stepped, hashed from 
+ * the program wide seed and t together.  Adding them instead would make
+ * seed s at step t + 1 the same as seed s + 1 at step t, so runs with 
+ * neighbouring seeds would replay each other a step apart. */
+uint64_t rng_step_seed(uint64_t t) {
+	return rng_mix(rng_mix(seed_all) + t * 0xd1b54a32d192ed03ull);
+}
+
+/* starts a stream.  Different (seed, stream) pairs give unrelated 
+ * sequences. */
+void rng_stream(rng_t *rng, uint64_t seed, uint64_t stream) {
+	rng->key = rng_mix(rng_mix(seed) + stream * 0x9e3779b97f4a7c15ull);
+	rng->counter = 0;
+}
+
+/* the next 32 random bits from a stream */
+uint32_t rng_next(rng_t *rng) {
+	return rng_at(rng->key, rng->counter++);
+}
+
+/* the next random float from a stream, in [0, 1) */
+float rng_float(rng_t *rng) {
+	return (rng_next(rng) >> 8) * (1.0f / 16777216.0f);
+}
+
+/* fills out with the next n random floats from a stream, in [0, 1).  
+ * Gives the same numbers as n calls to rng_float(), 4 at a time. */
+void rng_fill(rng_t *rng, float *out, int n) {
+	uint32_t c = rng->counter;
+	uint64_t key = rng->key;
+	int i = 0;
+#ifdef __SSE2__
+	const __m128i lo = _mm_set1_epi32((uint32_t)key);
+	const __m128i hi = _mm_set1_epi32((uint32_t)(key >> 32));
+	const __m128 scale = _mm_set1_ps(1.0f / 16777216.0f);
+	__m128i ctr = _mm_add_epi32(_mm_set1_epi32(c), _mm_set_epi32(3, 2, 1, 0));
+	__m128i x;
+
+	for(; i+4<=n; i+=4) {
+		x = rng_hash4(_mm_xor_si128(rng_hash4(_mm_add_epi32(ctr, lo)), hi));
+		_mm_storeu_ps(&out[i], _mm_mul_ps(scale, 
+			_mm_cvtepi32_ps(_mm_srli_epi32(x, 8))));
+		ctr = _mm_add_epi32(ctr, _mm_set1_epi32(4));
+	}
+#endif
+	for(; i<n; i++)
+		out[i] = (rng_at(key, c + i) >> 8) * (1.0f / 16777216.0f);
+	rng->counter += n;
+}
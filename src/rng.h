@@ -0,0 +1,59 @@
+/************************************************************************** 
+ * Nanobot:  A simple, interactive robot rendered using OpenGL
+ * Copyright (C) 2007, Corey Edmunds (corey.edmunds@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *************************************************************************/
+
+
+/**************************************************************************
+ * rng.c/h
+ *
+ * A counter based random number generator.  A stream is a key and a
+ * counter, and each number is a hash of the two, so streams never share
+ * state.  Work split in to chunks can give each chunk its own stream and
+ * get the same numbers no matter which thread runs it.
+ *
+ * Every stream is derived from one program wide seed (--seed), so runs 
+ * with the same seed are repeatable bit for bit.  The hash only uses 32 
+ * bit integer operations and numbers do not depend on each other, so 
+ * rng_fill() generates them a vector at a time.
+ *************************************************************************/
+#ifndef __RNG_H
+#define __RNG_H
+#include <stdint.h>
+
+/* stream numbers for users that only need one stream.  Chunked users
+ * number their streams from 0 and mix something else in to the seed. */
+enum rng_streams {
+	RNG_ANIMATE = 0x10000,
+	RNG_PARTICLE_SPAWN,
+	RNG_CURL
+};
+
+/* a random number stream */
+typedef struct {
+	uint64_t key;
+	uint64_t counter;
+} rng_t;
+
+void rng_seed(uint64_t seed);
+uint64_t rng_get_seed(void);
+uint64_t rng_step_seed(uint64_t t);
+void rng_stream(rng_t *rng, uint64_t seed, uint64_t stream);
+uint32_t rng_next(rng_t *rng);
+float rng_float(rng_t *rng);
+void rng_fill(rng_t *rng, float *out, int n);
+#endif
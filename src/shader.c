@@ -0,0 +1,91 @@
+/************************************************************************** 
+ * Nanobot:  A simple, interactive robot rendered using OpenGL
+ * Copyright (C) 2007, Corey Edmunds (corey.edmunds@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *************************************************************************/
+
+
+/**************************************************************************
+ * shader.c/h
+ *
+ * Helpers for compiling GLSL programs and checking what the GL 
+ * implementation supports.
+ *************************************************************************/
+#include "shader.h"
+#include <stdio.h>
+
+/* checks that the GL version is at least major.minor */
+int gl_version(int major, int minor) {
+	const char *version = (const char*)glGetString(GL_VERSION);
+	int ma = 0, mi = 0;
+
+	if ( !version || sscanf(version, "%d.%d", &ma, &mi) != 2 )
+		return 0;
+	return ma > major || (ma == major && mi >= minor);
+}
+
+/* compiles one shader, printing the log if it fails */
+static GLuint shader_compile(GLenum type, const char *source) {
+	GLuint shader = glCreateShader(type);
+	GLint ok;
+	char log[1024];
+
+	glShaderSource(shader, 1, &source, NULL);
+	glCompileShader(shader);
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+	if ( !ok ) {
+		glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+		printf("%s %d:  Shader failed to compile:\n%s\n", 
+			__FILE__, __LINE__, log);
+		glDeleteShader(shader);
+		return 0;
+	}
+	return shader;
+}
+
+/* compiles and links a program from vertex and fragment shader source.
+ * Returns 0 on failure (or if GL has no shaders). */
+GLuint shader_program(const char *vertex, const char *fragment) {
+	GLuint vs, fs, program;
+	GLint ok;
+	char log[1024];
+
+	if ( !gl_version(2, 0) )
+		return 0;
+	vs = shader_compile(GL_VERTEX_SHADER, vertex);
+	fs = shader_compile(GL_FRAGMENT_SHADER, fragment);
+	if ( !vs || !fs ) {
+		glDeleteShader(vs);
+		glDeleteShader(fs);
+		return 0;
+	}
+
+	program = glCreateProgram();
+	glAttachShader(program, vs);
+	glAttachShader(program, fs);
+	glLinkProgram(program);
+	glDeleteShader(vs);
+	glDeleteShader(fs);
+	glGetProgramiv(program, GL_LINK_STATUS, &ok);
+	if ( !ok ) {
+		glGetProgramInfoLog(program, sizeof(log), NULL, log);
+		printf("%s %d:  Shader failed to link:\n%s\n", 
+			__FILE__, __LINE__, log);
+		glDeleteProgram(program);
+		return 0;
+	}
+	return program;
+}
@@ -0,0 +1,290 @@
+/************************************************************************** 
+ * Nanobot:  A simple, interactive robot rendered using OpenGL
+ * Copyright (C) 2007, Corey Edmunds (corey.edmunds@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *************************************************************************/
+
+
+/**************************************************************************
+ * snapshot.c/h
+ *
+ * Saving and restoring the whole simulation: the joints, the animation,
+ * the random number seed, the emitters and the smoke.  A long smoky scene
+ * can be picked up again without running it all over, and a benchmark 
+ * can start from the same settled state every time.
+ *
+ * A snapshot is a header and then tagged sections.  Each module writes
+ * and reads its own section, so the format grows a section at a time;
+ * sections a reader doesn't know are skipped.  Everything is padded to 
+ * SNAPSHOT_ALIGN, so once the file is mapped a section's arrays can be 
+ * copied straight out with no parsing.  The numbers are in the writing
+ * machine's byte order, which the header records.
+ *************************************************************************/
+#include "snapshot.h"
+#include "rng.h"
+#include "joint.h"
+#include "animate.h"
+#include "kinematics.h"
+#include "particles.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SNAPSHOT_MAGIC "NANOSNAP"
+/* reads back as something else on a machine of the other byte order */
+#define SNAPSHOT_BYTE_ORDER 0x01020304
+#define SNAPSHOT_PAD(n) (((n) + SNAPSHOT_ALIGN - 1) & ~(size_t)(SNAPSHOT_ALIGN - 1))
+
+/* the file header.  size is the whole file's, so a snapshot that was 
+ * cut short is caught before anything is read from it. */
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	uint64_t size;
+	uint64_t reserved;
+} snapshot_header;
+
+/* a section's header, followed by size bytes of the section */
+typedef struct {
+	uint32_t tag;
+	uint32_t reserved;
+	uint64_t size;
+	uint64_t pad[2];
+} section_header;
+
+/* writes size bytes and pads them out to SNAPSHOT_ALIGN */
+static void snapshot_put(snapshot_writer *w, const void *data, size_t size) {
+	static const char zeros[SNAPSHOT_ALIGN];
+	size_t pad = SNAPSHOT_PAD(size) - size;
+
+	if ( w->failed )
+		return;
+	if ( size && fwrite(data, size, 1, w->file) != 1 )
+		w->failed = 1;
+	if ( pad && fwrite(zeros, pad, 1, w->file) != 1 )
+		w->failed = 1;
+}
+
+/* starts a section; the module that owns it then writes its parts with
+ * snapshot_write and closes it with snapshot_end */
+void snapshot_begin(snapshot_writer *w, enum snapshot_tag tag) {
+	section_header h;
+
+	memset(&h, 0, sizeof(h));
+	h.tag = tag;
+	snapshot_put(w, &h, sizeof(h));
+	w->start = ftell(w->file);
+}
+
+/* writes a part of the current section.  Each part starts aligned, so 
+ * parts can be read back with snapshot_read in the order written. */
+void snapshot_write(snapshot_writer *w, const void *data, size_t size) {
+	snapshot_put(w, data, size);
+}
+
+/* closes the current section, filling in its size */
+void snapshot_end(snapshot_writer *w) {
+	uint64_t size;
+	long end;
+
+	if ( w->failed )
+		return;
+	end = ftell(w->file);
+	size = end - w->start;
+	if ( fseek(w->file, w->start - sizeof(section_header) + 
+			offsetof(section_header, size), SEEK_SET) || 
+			fwrite(&size, sizeof(size), 1, w->file) != 1 ||
+			fseek(w->file, end, SEEK_SET) )
+		w->failed = 1;
+}
+
+/* finds the section tagged tag and sets r up to read it.  Returns 0 if
+ * the snapshot has no such section. */
+int snapshot_find(const snapshot_t *s, enum snapshot_tag tag, 
+		snapshot_reader *r) {
+	const section_header *h;
+	size_t at = SNAPSHOT_PAD(sizeof(snapshot_header));
+
+	while ( at + sizeof(section_header) <= s->size ) {
+		h = (const section_header*)(s->data + at);
+		at += SNAPSHOT_PAD(sizeof(section_header));
+		if ( h->size > s->size - at )
+			return 0;
+		if ( h->tag == tag ) {
+			r->data = s->data + at;
+			r->size = h->size;
+			r->at = 0;
+			return 1;
+		}
+		at += h->size;
+	}
+	return 0;
+}
+
+/* reads the next part, of size bytes, of r's section.  Returns where it
+ * is in the mapping, aligned to SNAPSHOT_ALIGN, or NULL if the section 
+ * is too short. */
+const void *snapshot_read(snapshot_reader *r, size_t size) {
+	const void *part;
+
+	if ( SNAPSHOT_PAD(size) > r->size - r->at )
+		return NULL;
+	part = r->data + r->at;
+	r->at += SNAPSHOT_PAD(size);
+	return part;
+}
+
+/* saves the simulation to path.  It is written next to path and moved 
+ * in to place when it is complete, so an old snapshot is never left half
+ * written over.  Returns 0 on failure. */
+int snapshot_save(const char *path) {
+	snapshot_writer w;
+	snapshot_header h;
+	uint64_t seed;
+	char *temp;
+	int ok;
+
+	temp = malloc(strlen(path) + 5);
+	if ( !temp ) 
+		return 0;
+	sprintf(temp, "%s.new", path);
+	w.file = fopen(temp, "wb");
+	if ( !w.file ) {
+		printf("%s %d:  can't write %s: %s\n", __FILE__, __LINE__, 
+			temp, strerror(errno));
+		free(temp);
+		return 0;
+	}
+	w.start = 0;
+	w.failed = 0;
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic));
+	h.version = SNAPSHOT_VERSION;
+	h.byte_order = SNAPSHOT_BYTE_ORDER;
+	snapshot_put(&w, &h, sizeof(h));
+
+	seed = rng_get_seed();
+	snapshot_begin(&w, SNAP_RNG);
+	snapshot_write(&w, &seed, sizeof(seed));
+	snapshot_end(&w);
+	joints_save(&w);
+	animate_save(&w);
+	particles_save(&w);
+
+	/* the size goes in last */
+	if ( !w.failed ) {
+		h.size = ftell(w.file);
+		if ( fseek(w.file, 0, SEEK_SET) || 
+				fwrite(&h, sizeof(h), 1, w.file) != 1 )
+			w.failed = 1;
+	}
+	ok = !w.failed;
+	if ( fclose(w.file) )
+		ok = 0;
+	if ( ok && rename(temp, path) )
+		ok = 0;
+	if ( !ok ) {
+		printf("%s %d:  can't write %s: %s\n", __FILE__, __LINE__, 
+			path, strerror(errno));
+		remove(temp);
+	}
+	free(temp);
+	return ok;
+}
+
+/* restores the simulation from the snapshot at path.  The file is mapped
+ * rather than read, and each module copies its section straight out of
+ * the mapping.  Every section is checked before any is restored, so a
+ * snapshot that is refused leaves the simulation as it was.  Must be 
+ * called from the GL thread, between ticks.  Returns 0 if the snapshot
+ * can't be used. */
+int snapshot_load(const char *path) {
+	const snapshot_header *h;
+	const uint64_t *seed;
+	uint64_t old_seed;
+	snapshot_reader r;
+	snapshot_t s;
+	struct stat st;
+	void *map;
+	int fd, ok;
+
+	fd = open(path, O_RDONLY);
+	if ( fd < 0 || fstat(fd, &st) ) {
+		printf("%s %d:  can't read %s: %s\n", __FILE__, __LINE__, 
+			path, strerror(errno));
+		if ( fd >= 0 )
+			close(fd);
+		return 0;
+	}
+	if ( (size_t)st.st_size < SNAPSHOT_PAD(sizeof(snapshot_header)) ) {
+		printf("%s %d:  %s is not a snapshot\n", __FILE__, __LINE__, path);
+		close(fd);
+		return 0;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if ( map == MAP_FAILED ) {
+		printf("%s %d:  can't map %s: %s\n", __FILE__, __LINE__, 
+			path, strerror(errno));
+		return 0;
+	}
+	s.data = map;
+	s.size = st.st_size;
+
+	ok = 0;
+	h = (const snapshot_header*)s.data;
+	if ( memcmp(h->magic, SNAPSHOT_MAGIC, sizeof(h->magic)) || 
+			h->byte_order != SNAPSHOT_BYTE_ORDER )
+		printf("%s %d:  %s is not a snapshot from this machine\n", 
+			__FILE__, __LINE__, path);
+	else if ( h->version != SNAPSHOT_VERSION )
+		printf("%s %d:  %s is version %u, not %d\n", __FILE__, __LINE__, 
+			path, h->version, SNAPSHOT_VERSION);
+	else if ( h->size != s.size )
+		printf("%s %d:  %s is cut short\n", __FILE__, __LINE__, path);
+	else if ( !snapshot_find(&s, SNAP_RNG, &r) || 
+			!(seed = snapshot_read(&r, sizeof(*seed))) )
+		printf("%s %d:  %s has no seed\n", __FILE__, __LINE__, path);
+	else if ( !joints_check(&s) || !animate_check(&s) || 
+			!particles_check(&s) )
+		printf("%s %d:  %s is damaged\n", __FILE__, __LINE__, path);
+	else {
+		/* the smoke goes first: it can still fail for want of memory,
+		 * and needs the seed for its turbulence */
+		old_seed = rng_get_seed();
+		rng_seed(*seed);
+		ok = particles_restore(&s);
+		if ( ok ) {
+			joints_restore(&s);
+			animate_restore(&s);
+			kinematics_think();
+		} else {
+			rng_seed(old_seed);
+			printf("%s %d:  no room for the smoke in %s\n", 
+				__FILE__, __LINE__, path);
+		}
+	}
+
+	munmap(map, st.st_size);
+	return ok;
+}
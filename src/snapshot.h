@@ -0,0 +1,87 @@
+/************************************************************************** 
+ * Nanobot:  A simple, interactive robot rendered using OpenGL
+ * Copyright (C) 2007, Corey Edmunds (corey.edmunds@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *************************************************************************/
+
+
+/**************************************************************************
+ * snapshot.c/h
+ *
+ * Saving and restoring the whole simulation: the joints, the animation,
+ * the random number seed, the emitters and the smoke.  A long smoky scene
+ * can be picked up again without running it all over, and a benchmark 
+ * can start from the same settled state every time.
+ *
+ * A snapshot is a header and then tagged sections.  Each module writes
+ * and reads its own section, so the format grows a section at a time;
+ * sections a reader doesn't know are skipped.  Everything is padded to 
+ * SNAPSHOT_ALIGN, so once the file is mapped a section's arrays can be 
+ * copied straight out with no parsing.  The numbers are in the writing
+ * machine's byte order, which the header records.
+ *************************************************************************/
+#ifndef __SNAPSHOT_H
+#define __SNAPSHOT_H
+#include <stdio.h>
+#include <stddef.h>
+
+/* bump whenever a saved structure changes, so old snapshots are refused
+ * instead of misread */
+#define SNAPSHOT_VERSION 5
+
+/* what everything in a snapshot is padded to: the widest vector load */
+#define SNAPSHOT_ALIGN 32
+
+/* the sections */
+enum snapshot_tag {
+	SNAP_RNG = 1,
+	SNAP_JOINTS,
+	SNAP_ANIMATE,
+	SNAP_EMITTERS,
+	SNAP_PARTICLES,
+	SNAP_VOLUME
+};
+
+/* a snapshot being written.  A failed write is remembered and reported
+ * when the snapshot is closed. */
+typedef struct {
+	FILE *file;
+	long start;
+	int failed;
+} snapshot_writer;
+
+/* a mapped snapshot */
+typedef struct {
+	const unsigned char *data;
+	size_t size;
+} snapshot_t;
+
+/* a section of a mapped snapshot, read from the front */
+typedef struct {
+	const unsigned char *data;
+	size_t size;
+	size_t at;
+} snapshot_reader;
+
+void snapshot_begin(snapshot_writer *w, enum snapshot_tag tag);
+void snapshot_write(snapshot_writer *w, const void *data, size_t size);
+void snapshot_end(snapshot_writer *w);
+int snapshot_find(const snapshot_t *s, enum snapshot_tag tag, 
+	snapshot_reader *r);
+const void *snapshot_read(snapshot_reader *r, size_t size);
+int snapshot_save(const char *path);
+int snapshot_load(const char *path);
+#endif
@@ -0,0 +1,219 @@
+/************************************************************************** 
+ * Nanobot:  A simple, interactive robot rendered using OpenGL
+ * Copyright (C) 2007, Corey Edmunds (corey.edmunds@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *************************************************************************/
+
+
+/**************************************************************************
+ * sort.c/h
+ *
+ * Sorts indexes by float keys (ie. particles by depth).  Keys are turned
+ * in to unsigned integers that order the same way, and the (key, index)
+ * pairs are put in order with an LSD radix sort.  The coherent sort
+ * starts from the previous order instead, which is nearly sorted when the
+ * keys only move a little between calls, and only sorts what moved.
+ *************************************************************************/
+#include "sort.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* bits sorted per radix pass */
+#define RADIX_BITS 8
+#define RADIX_SIZE (1 << RADIX_BITS)
+#define RADIX_PASSES (32 / RADIX_BITS)
+/* the coherent sort gives up and radix sorts everything once more than
+ * 1 in this many pairs are out of place */
+#define COHERENT_LIMIT 4
+
+/* maps a float to an unsigned int with the same ordering:  positive
+ * floats get their sign bit set, negative floats are inverted entirely */
+static unsigned int key_bits(float f) {
+	union { float f; unsigned int u; } v;
+
+	v.f = f;
+	return v.u ^ (-(v.u >> 31) | 0x80000000u);
+}
+
+/* allocates a sorter for up to capacity keys.  Returns 0 on failure. */
+int key_sort_init(key_sort *ks, int capacity) {
+	ks->pairs = malloc(sizeof(sort_pair) * capacity);
+	ks->scratch = malloc(sizeof(sort_pair) * capacity);
+	ks->spare = malloc(sizeof(sort_pair) * capacity);
+	ks->count = 0;
+	ks->capacity = capacity;
+	if ( !ks->pairs || !ks->scratch || !ks->spare ) {
+		key_sort_free(ks);
+		return 0;
+	}
+	return 1;
+}
+
+/* frees a sorter */
+void key_sort_free(key_sort *ks) {
+	free(ks->pairs);
+	free(ks->scratch);
+	free(ks->spare);
+	ks->pairs = ks->scratch = ks->spare = NULL;
+	ks->count = ks->capacity = 0;
+}
+
+/* LSD radix sorts count pairs from src by key, using tmp as the other 
+ * buffer.  Passes where every key has the same digit are skipped, which 
+ * is common for the high bits.  Returns whichever buffer ended up 
+ * holding the result. */
+static sort_pair *radix_pairs(sort_pair *src, sort_pair *tmp, int count) {
+	unsigned int hist[RADIX_PASSES][RADIX_SIZE];
+	sort_pair *dst = tmp;
+	unsigned int sum, c;
+	int i, p, shift;
+
+	if ( count <= 1 )
+		return src;
+
+	memset(hist, 0, sizeof(hist));
+	for(i=0; i<count; i++)
+		for(p=0; p<RADIX_PASSES; p++)
+			hist[p][(src[i].key >> (p * RADIX_BITS)) & (RADIX_SIZE-1)]++;
+
+	for(p=0; p<RADIX_PASSES; p++) {
+		shift = p * RADIX_BITS;
+		if ( hist[p][(src[0].key >> shift) & (RADIX_SIZE-1)] == 
+				(unsigned int)count )
+			continue;
+
+		/* turn the histogram in to starting offsets */
+		sum = 0;
+		for(i=0; i<RADIX_SIZE; i++) {
+			c = hist[p][i];
+			hist[p][i] = sum;
+			sum += c;
+		}
+		for(i=0; i<count; i++)
+			dst[hist[p][(src[i].key >> shift) & (RADIX_SIZE-1)]++] = src[i];
+
+		tmp = src;
+		src = dst;
+		dst = tmp;
+	}
+
+	return src;
+}
+
+/* radix sorts the sorter's pairs in place */
+static void radix_all(key_sort *ks) {
+	sort_pair *sorted = radix_pairs(ks->pairs, ks->scratch, ks->count);
+
+	if ( sorted != ks->pairs ) {
+		ks->scratch = ks->pairs;
+		ks->pairs = sorted;
+	}
+}
+
+/* sorts indexes [0, count) by keys from scratch */
+void key_sort_radix(key_sort *ks, const float *keys, int count) {
+	int i;
+
+	if ( count > ks->capacity )
+		count = ks->capacity;
+	ks->count = count;
+	if ( count <= 0 )
+		return;
+	for(i=0; i<count; i++) {
+		ks->pairs[i].key = key_bits(keys[i]);
+		ks->pairs[i].index = i;
+	}
+	radix_all(ks);
+}
+
+/* sorts indexes [0, count) by keys, starting from the order left by the
+ * last sort.  count may differ from last time: indexes past the end are
+ * dropped and new ones are added at the end.
+ *
+ * The keys are refreshed in the old order and split in to the pairs 
+ * that are still in order, and the ones that moved (are smaller than the 
+ * last pair kept, or bigger than the pair after them).  Only the moved 
+ * pairs get sorted, and they are merged back in with one linear pass.  
+ * If too many moved, everything is radix sorted instead. */
+void key_sort_coherent(key_sort *ks, const float *keys, int count) {
+	sort_pair *kept = ks->pairs;
+	sort_pair *moved = ks->scratch;
+	sort_pair *out;
+	sort_pair *tmp;
+	int nkept, nmoved, n, i, j, k;
+
+	if ( count > ks->capacity )
+		count = ks->capacity;
+	if ( ks->count <= 0 || count <= 0 ) {
+		key_sort_radix(ks, keys, count);
+		return;
+	}
+
+	/* refresh the keys, dropping indexes that no longer exist */
+	n = 0;
+	for(i=0; i<ks->count; i++) {
+		if ( ks->pairs[i].index >= (unsigned int)count )
+			continue;
+		ks->pairs[n].index = ks->pairs[i].index;
+		ks->pairs[n].key = key_bits(keys[ks->pairs[i].index]);
+		n++;
+	}
+	for(i=ks->count; i<count; i++) {
+		ks->pairs[n].index = i;
+		ks->pairs[n].key = key_bits(keys[i]);
+		n++;
+	}
+	ks->count = count;
+
+	/* split off the pairs that are out of place */
+	nkept = nmoved = 0;
+	for(i=0; i<count; i++) {
+		if ( (nkept > 0 && ks->pairs[i].key < kept[nkept-1].key) || 
+				(i+1 < count && ks->pairs[i].key > ks->pairs[i+1].key) )
+			moved[nmoved++] = ks->pairs[i];
+		else
+			kept[nkept++] = ks->pairs[i];
+		if ( nmoved * COHERENT_LIMIT > count ) {
+			/* too much changed; finish the split unsorted and
+			 * radix sort the lot */
+			for(i++; i<count; i++)
+				moved[nmoved++] = ks->pairs[i];
+			memcpy(&kept[nkept], moved, sizeof(sort_pair) * nmoved);
+			radix_all(ks);
+			return;
+		}
+	}
+	if ( nmoved == 0 )
+		return;
+
+	/* sort what moved, then merge it back in */
+	moved = radix_pairs(moved, ks->spare, nmoved);
+	out = moved == ks->scratch ? ks->spare : ks->scratch;
+	i = j = k = 0;
+	while ( i < nkept && j < nmoved )
+		out[k++] = moved[j].key < kept[i].key ? moved[j++] : kept[i++];
+	while ( i < nkept )
+		out[k++] = kept[i++];
+	while ( j < nmoved )
+		out[k++] = moved[j++];
+
+	tmp = ks->pairs;
+	ks->pairs = out;
+	if ( out == ks->scratch )
+		ks->scratch = tmp;
+	else 
+		ks->spare = tmp;
+}
@@ -0,0 +1,55 @@
+/************************************************************************** 
+ * Nanobot:  A simple, interactive robot rendered using OpenGL
+ * Copyright (C) 2007, Corey Edmunds (corey.edmunds@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *************************************************************************/
+
+
+/**************************************************************************
+ * sort.c/h
+ *
+ * Sorts indexes by float keys (ie. particles by depth).  Keys are turned
+ * in to unsigned integers that order the same way, and the (key, index)
+ * pairs are put in order with an LSD radix sort.  The coherent sort
+ * starts from the previous order instead, which is nearly sorted when the
+ * keys only move a little between calls, and only sorts what moved.
+ *************************************************************************/
+#ifndef __SORT_H
+#define __SORT_H
+
+/* a key and the index it belongs to */
+typedef struct {
+	unsigned int key;
+	unsigned int index;
+} sort_pair;
+
+/* a sorter and its order from the last call */
+typedef struct {
+	sort_pair *pairs;
+	sort_pair *scratch;
+	sort_pair *spare;
+	int count;
+	int capacity;
+} key_sort;
+
+int key_sort_init(key_sort *ks, int capacity);
+void key_sort_free(key_sort *ks);
+void key_sort_radix(key_sort *ks, const float *keys, int count);
+void key_sort_coherent(key_sort *ks, const float *keys, int count);
+
+/* the index of the i'th smallest key after a sort */
+#define KEY_SORT_INDEX(ks, i) ((ks)->pairs[i].index)
+#endif
@@ -0,0 +1,169 @@
+/************************************************************************** 
+ * Nanobot:  A simple, interactive robot rendered using OpenGL
+ * Copyright (C) 2007, Corey Edmunds (corey.edmunds@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *************************************************************************/
+
+
+/**************************************************************************
+ * stream.c/h
+ *
+ * A streamed vertex buffer for drawing a batch of quads with one call.
+ * Every frame the buffer is orphaned, mapped and filled in one pass, then
+ * drawn as indexed triangles from a static index buffer.  Without vertex
+ * buffer objects (GL < 1.5) the same thing is done with client side
+ * vertex arrays.
+ *************************************************************************/
+#include "stream.h"
+#include "shader.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* sets up a stream of up to quads quads, each vertex stride bytes.  
+ * Returns 0 on failure. */
+int quad_stream_init(quad_stream *qs, int stride, int quads) {
+	GLuint *idx;
+	int i;
+
+	qs->stride = stride;
+	qs->quads = quads;
+	qs->use_vbo = gl_version(1, 5);
+	qs->mem = NULL;
+	qs->indexes = NULL;
+
+	/* two triangles per quad, 0-1-2 and 0-2-3 */
+	idx = malloc(sizeof(GLuint) * 6 * quads);
+	if ( !idx )
+		return 0;
+	for(i=0; i<quads; i++) {
+		idx[i*6+0] = i*4+0;
+		idx[i*6+1] = i*4+1;
+		idx[i*6+2] = i*4+2;
+		idx[i*6+3] = i*4+0;
+		idx[i*6+4] = i*4+2;
+		idx[i*6+5] = i*4+3;
+	}
+
+	if ( !qs->use_vbo ) {
+		qs->indexes = idx;
+		qs->mem = malloc((size_t)stride * 4 * quads);
+		if ( !qs->mem ) {
+			free(idx);
+			qs->indexes = NULL;
+			return 0;
+		}
+		return 1;
+	}
+
+	glGenBuffers(1, &qs->vbo);
+	glGenBuffers(1, &qs->ibo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, qs->ibo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * 6 * quads, 
+		idx, GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ARRAY_BUFFER, qs->vbo);
+	glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)stride * 4 * quads, 
+		NULL, GL_STREAM_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	free(idx);
+	return 1;
+}
+
+/* frees a stream.  Freeing a zeroed stream does nothing. */
+void quad_stream_free(quad_stream *qs) {
+	if ( qs->use_vbo ) {
+		glDeleteBuffers(1, &qs->vbo);
+		glDeleteBuffers(1, &qs->ibo);
+	}
+	free(qs->mem);
+	free(qs->indexes);
+	qs->use_vbo = 0;
+	qs->mem = NULL;
+	qs->indexes = NULL;
+	qs->quads = 0;
+}
+
+/* returns memory to write this frame's vertices in to.  The old contents
+ * are orphaned, so the driver never has to wait for the last frame's draw
+ * to finish.  May return NULL if the buffer could not be mapped. */
+void *quad_stream_map(quad_stream *qs) {
+	void *mem;
+
+	if ( !qs->use_vbo )
+		return qs->mem;
+
+	glBindBuffer(GL_ARRAY_BUFFER, qs->vbo);
+	glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)qs->stride * 4 * qs->quads, 
+		NULL, GL_STREAM_DRAW);
+	mem = glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY);
+	if ( !mem )
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return mem;
+}
+
+/* finishes writing vertices.  Returns the base to hand to the gl*Pointer
+ * calls: an offset in to the bound buffer, or the client side memory. 
+ * The buffer stays bound until quad_stream_draw. */
+char *quad_stream_unmap(quad_stream *qs) {
+	if ( !qs->use_vbo )
+		return qs->mem;
+
+	if ( !glUnmapBuffer(GL_ARRAY_BUFFER) )
+		printf("%s %d:  Vertex buffer lost\n", __FILE__, __LINE__);
+	return NULL;
+}
+
+/* writes quads [first, first + count) from data, leaving the rest of the
+ * stream as it was.  For streams that are kept from frame to frame and
+ * only partly rewritten, instead of mapped and filled. */
+void quad_stream_write(quad_stream *qs, int first, int count, const void *data) {
+	size_t size = (size_t)qs->stride * 4;
+
+	if ( !qs->use_vbo ) {
+		memcpy(qs->mem + size * first, data, size * count);
+		return;
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, qs->vbo);
+	glBufferSubData(GL_ARRAY_BUFFER, size * first, size * count, data);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+/* gets a stream ready to draw as it is, without writing it.  Returns the
+ * base to hand to the gl*Pointer calls, like quad_stream_unmap. */
+char *quad_stream_bind(quad_stream *qs) {
+	if ( !qs->use_vbo )
+		return qs->mem;
+
+	glBindBuffer(GL_ARRAY_BUFFER, qs->vbo);
+	return NULL;
+}
+
+/* draws the first quads quads of the stream */
+void quad_stream_draw(quad_stream *qs, int quads) {
+	if ( quads > qs->quads )
+		quads = qs->quads;
+
+	if ( !qs->use_vbo ) {
+		glDrawElements(GL_TRIANGLES, quads * 6, GL_UNSIGNED_INT, qs->indexes);
+		return;
+	}
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, qs->ibo);
+	glDrawElements(GL_TRIANGLES, quads * 6, GL_UNSIGNED_INT, NULL);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
@@ -0,0 +1,57 @@
+/************************************************************************** 
+ * Nanobot:  A simple, interactive robot rendered using OpenGL
+ * Copyright (C) 2007, Corey Edmunds (corey.edmunds@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *************************************************************************/
+
+
+/**************************************************************************
+ * stream.c/h
+ *
+ * A streamed vertex buffer for drawing a batch of quads with one call.
+ * Every frame the buffer is orphaned, mapped and filled in one pass, then
+ * drawn as indexed triangles from a static index buffer.  Without vertex
+ * buffer objects (GL < 1.5) the same thing is done with client side
+ * vertex arrays.
+ *************************************************************************/
+#ifndef __STREAM_H
+#define __STREAM_H
+/* the buffer object calls are only declared with this set, so include
+ * this before any other GL header */
+#ifndef GL_GLEXT_PROTOTYPES
+	#define GL_GLEXT_PROTOTYPES
+#endif
+#include <GL/gl.h>
+
+/* a quad stream.  Each quad is 4 vertices of stride bytes. */
+typedef struct {
+	GLuint vbo;
+	GLuint ibo;
+	int use_vbo;
+	char *mem;
+	GLuint *indexes;
+	int stride;
+	int quads;
+} quad_stream;
+
+int quad_stream_init(quad_stream *qs, int stride, int quads);
+void quad_stream_free(quad_stream *qs);
+void *quad_stream_map(quad_stream *qs);
+char *quad_stream_unmap(quad_stream *qs);
+void quad_stream_write(quad_stream *qs, int first, int count, const void *data);
+char *quad_stream_bind(quad_stream *qs);
+void quad_stream_draw(quad_stream *qs, int quads);
+#endif
@@ -0,0 +1,341 @@
+/************************************************************************** 
+ * Nanobot:  A simple, interactive robot rendered using OpenGL
+ * Copyright (C) 2007, Corey Edmunds (corey.edmunds@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *************************************************************************/
+
+
+/**************************************************************************
+ * volume.c/h
+ *
+ * Volumetric smoke: density and velocity on a fixed 3D grid around the
+ * robot, instead of particles.  The emitters pour density and velocity
+ * in, and each tick both are carried along the velocity with a 
+ * semi-Lagrangian step (each cell looks back along its velocity and 
+ * takes what was there), one slab of the grid per worker job.  It is 
+ * drawn as a stack of textured slices through a 3D texture, so the cost
+ * is set by the grid size and not by how much smoke there is.
+ *
+ * There is no pressure solve; the smoke is not kept incompressible.  It
+ * only has to look like exhaust, and the solve would cost more than 
+ * everything else here put together.
+ *************************************************************************/
+#ifndef GL_GLEXT_PROTOTYPES
+	#define GL_GLEXT_PROTOTYPES
+#endif
+#include <GL/gl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "volume.h"
+#include "shader.h"
+#include "workers.h"
+
+#define VOLUME_CELLS (VOLUME_SIZE * VOLUME_SIZE * VOLUME_SIZE)
+/* the grid covers a cube VOLUME_EXTENT across from volume_min */
+#define VOLUME_EXTENT 6.0f
+/* the density and velocity left after a tick */
+#define VOLUME_FADE 0.99f
+#define VOLUME_DRAG 0.99f
+/* how thick a slice's worth of density 1 looks */
+#define VOLUME_OPACITY 0.35f
+
+/* the index of cell (x, y, z) */
+#define CELL(x, y, z) (((z) * VOLUME_SIZE + (y)) * VOLUME_SIZE + (x))
+
+static const float volume_min[3] = { -3, -2.5, -3 };
+
+/* the fields.  [current] is this tick's and [!current] is written by 
+ * the next advection.  The velocity is in cells per tick. */
+enum { DENSITY, VEL_X, VEL_Y, VEL_Z, FIELDS };
+static float *fields[2][FIELDS];
+static int current;
+/* the density as texture alpha, and whether it has changed since it was
+ * last uploaded */
+static unsigned char *opacity;
+static int dirty;
+static GLuint texid;
+/* the lift and floor (as a cell y) for this tick's advection */
+static float tick_lift;
+static float tick_ground;
+
+static void volume_advect_slab(int z, void *arg);
+
+/* frees the fields and the opacity, leaving the pointers NULL so that 
+ * init_volume starts again from nothing */
+static void volume_free(void) {
+	int f, b;
+
+	for(b=0; b<2; b++)
+		for(f=0; f<FIELDS; f++) {
+			free(fields[b][f]);
+			fields[b][f] = NULL;
+		}
+	free(opacity);
+	opacity = NULL;
+}
+
+/* allocates the grid and its texture.  Needs GL 1.2 for 3D textures.
+ * Returns 0 on failure. */
+int init_volume(void) {
+	int f, b;
+
+	if ( opacity )
+		return 1;
+	if ( !gl_version(1, 2) )
+		return 0;
+	for(b=0; b<2; b++)
+		for(f=0; f<FIELDS; f++) {
+			fields[b][f] = malloc(sizeof(float) * VOLUME_CELLS);
+			if ( !fields[b][f] ) {
+				volume_free();
+				return 0;
+			}
+		}
+	opacity = malloc(VOLUME_CELLS);
+	if ( !opacity ) {
+		volume_free();
+		return 0;
+	}
+
+	glGenTextures(1, &texid);
+	glBindTexture(GL_TEXTURE_3D, texid);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_3D, 0);
+	volume_clear();
+	return 1;
+}
+
+/* clears away all the smoke */
+void volume_clear(void) {
+	int b, f;
+
+	for(b=0; b<2; b++)
+		for(f=0; f<FIELDS; f++)
+			memset(fields[b][f], 0, sizeof(float) * VOLUME_CELLS);
+	memset(opacity, 0, VOLUME_CELLS);
+	dirty = 1;
+}
+
+/* adds amount of density at pos, moving at vel (world units per tick).
+ * It is shared out over the 8 cells around pos, and the velocity of 
+ * those cells pulled towards vel by the same shares. */
+void volume_inject(const float *pos, const float *vel, float amount) {
+	const float scale = VOLUME_SIZE / VOLUME_EXTENT;
+	float p[3], f[3], v[3], w;
+	int c[3], dx, dy, dz, i, a;
+
+	for(a=0; a<3; a++) {
+		p[a] = (pos[a] - volume_min[a]) * scale - 0.5f;
+		c[a] = floorf(p[a]);
+		f[a] = p[a] - c[a];
+		v[a] = vel[a] * scale;
+		if ( c[a] < 0 || c[a] >= VOLUME_SIZE - 1 )
+			return;
+	}
+	for(dz=0; dz<2; dz++)
+		for(dy=0; dy<2; dy++)
+			for(dx=0; dx<2; dx++) {
+				w = (dx ? f[0] : 1 - f[0]) * (dy ? f[1] : 1 - f[1]) * 
+					(dz ? f[2] : 1 - f[2]);
+				i = CELL(c[0] + dx, c[1] + dy, c[2] + dz);
+				fields[current][DENSITY][i] += amount * w;
+				fields[current][VEL_X][i] += (v[0] - fields[current][VEL_X][i]) * w;
+				fields[current][VEL_Y][i] += (v[1] - fields[current][VEL_Y][i]) * w;
+				fields[current][VEL_Z][i] += (v[2] - fields[current][VEL_Z][i]) * w;
+			}
+}
+
+/* samples field f at (x, y, z), in cells, trilinearly.  Outside the grid
+ * the nearest cell is used. */
+static float volume_sample(const float *f, float x, float y, float z) {
+	float fx, fy, fz, a, b;
+	int ix, iy, iz, i;
+
+	if ( x < 0 ) x = 0;
+	if ( y < 0 ) y = 0;
+	if ( z < 0 ) z = 0;
+	if ( x > VOLUME_SIZE - 1.001f ) x = VOLUME_SIZE - 1.001f;
+	if ( y > VOLUME_SIZE - 1.001f ) y = VOLUME_SIZE - 1.001f;
+	if ( z > VOLUME_SIZE - 1.001f ) z = VOLUME_SIZE - 1.001f;
+	ix = x;
+	iy = y;
+	iz = z;
+	fx = x - ix;
+	fy = y - iy;
+	fz = z - iz;
+	i = CELL(ix, iy, iz);
+
+	a = (f[i] * (1 - fx) + f[i+1] * fx) * (1 - fy) + 
+		(f[i+VOLUME_SIZE] * (1 - fx) + f[i+VOLUME_SIZE+1] * fx) * fy;
+	i += VOLUME_SIZE * VOLUME_SIZE;
+	b = (f[i] * (1 - fx) + f[i+1] * fx) * (1 - fy) + 
+		(f[i+VOLUME_SIZE] * (1 - fx) + f[i+VOLUME_SIZE+1] * fx) * fy;
+	return a * (1 - fz) + b * fz;
+}
+
+/* advects one z slab of the grid from [current] in to [!current], and
+ * works out its opacity.  Each slab only writes its own cells, so the 
+ * slabs can run at once.  Run on the worker threads. */
+static void volume_advect_slab(int z, void *arg) {
+	float **from = fields[current];
+	float **to = fields[!current];
+	float bx, by, bz, d;
+	int x, y, i;
+
+	if ( arg ) arg = arg; /* shut up compiler */
+	for(y=0; y<VOLUME_SIZE; y++)
+		for(x=0; x<VOLUME_SIZE; x++) {
+			i = CELL(x, y, z);
+			bx = x - from[VEL_X][i];
+			by = y - from[VEL_Y][i];
+			bz = z - from[VEL_Z][i];
+
+			d = volume_sample(from[DENSITY], bx, by, bz) * VOLUME_FADE;
+			to[DENSITY][i] = d;
+			to[VEL_X][i] = volume_sample(from[VEL_X], bx, by, bz) * VOLUME_DRAG;
+			to[VEL_Y][i] = volume_sample(from[VEL_Y], bx, by, bz) * VOLUME_DRAG
+				+ tick_lift;
+			to[VEL_Z][i] = volume_sample(from[VEL_Z], bx, by, bz) * VOLUME_DRAG;
+			/* smoke can't sink through the floor */
+			if ( y <= tick_ground && to[VEL_Y][i] < 0 )
+				to[VEL_Y][i] = 0;
+
+			opacity[i] = 255 * (1 - expf(-d * VOLUME_OPACITY));
+		}
+}
+
+/* moves the smoke on a tick.  lift is added to the upwards velocity 
+ * and ground is the floor height, both in world units. */
+void volume_think(float lift, float ground) {
+	const float scale = VOLUME_SIZE / VOLUME_EXTENT;
+
+	tick_lift = lift * scale;
+	tick_ground = (ground - volume_min[1]) * scale;
+	workers_run(VOLUME_SIZE, volume_advect_slab, NULL);
+	current = !current;
+	dirty = 1;
+}
+
+/* draws the smoke in color as slices through the grid, back to front.  
+ * The camera looks down -z and never turns, so the slices are all 
+ * square on to it; with a camera that turned they would need to follow
+ * it.  Must be called with the modelview the emitters' positions are 
+ * relative to. */
+void volume_render(const float *color) {
+	float z, r;
+	int s;
+
+	glBindTexture(GL_TEXTURE_3D, texid);
+	if ( dirty ) {
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexImage3D(GL_TEXTURE_3D, 0, GL_ALPHA, VOLUME_SIZE, VOLUME_SIZE,
+			VOLUME_SIZE, 0, GL_ALPHA, GL_UNSIGNED_BYTE, opacity);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		dirty = 0;
+	}
+
+	glPushAttrib(GL_ENABLE_BIT | GL_DEPTH_BUFFER_BIT | GL_CURRENT_BIT);
+	glDisable(GL_LIGHTING);
+	glDisable(GL_CULL_FACE);
+	glDisable(GL_TEXTURE_2D);
+	glEnable(GL_TEXTURE_3D);
+	glDepthMask(GL_FALSE);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+	glColor4f(color[0], color[1], color[2], 1);
+
+	/* one slice through the middle of each layer of cells */
+	glBegin(GL_QUADS);
+	for(s=0; s<VOLUME_SIZE; s++) {
+		r = (s + 0.5f) / VOLUME_SIZE;
+		z = volume_min[2] + r * VOLUME_EXTENT;
+		glTexCoord3f(0, 0, r);
+		glVertex3f(volume_min[0], volume_min[1], z);
+		glTexCoord3f(1, 0, r);
+		glVertex3f(volume_min[0] + VOLUME_EXTENT, volume_min[1], z);
+		glTexCoord3f(1, 1, r);
+		glVertex3f(volume_min[0] + VOLUME_EXTENT, 
+			volume_min[1] + VOLUME_EXTENT, z);
+		glTexCoord3f(0, 1, r);
+		glVertex3f(volume_min[0], volume_min[1] + VOLUME_EXTENT, z);
+	}
+	glEnd();
+
+	glPopAttrib();
+	glBindTexture(GL_TEXTURE_3D, 0);
+}
+
+/* writes the smoke to a snapshot.  There is nothing to write if the 
+ * grid was never allocated. */
+void volume_save(snapshot_writer *w) {
+	int f;
+
+	if ( !opacity )
+		return;
+	snapshot_begin(w, SNAP_VOLUME);
+	for(f=0; f<FIELDS; f++)
+		snapshot_write(w, fields[current][f], sizeof(float) * VOLUME_CELLS);
+	snapshot_write(w, opacity, VOLUME_CELLS);
+	snapshot_end(w);
+}
+
+/* finds the smoke in a snapshot, leaving saved NULL if it has none.  
+ * Returns 0 if it is cut short. */
+static int volume_find(const snapshot_t *s, const void **saved) {
+	snapshot_reader r;
+	int f;
+
+	saved[0] = NULL;
+	if ( !snapshot_find(s, SNAP_VOLUME, &r) )
+		return 1;
+	for(f=0; f<FIELDS; f++)
+		if ( !(saved[f] = snapshot_read(&r, sizeof(float) * VOLUME_CELLS)) )
+			return 0;
+	if ( !(saved[FIELDS] = snapshot_read(&r, VOLUME_CELLS)) )
+		return 0;
+	return 1;
+}
+
+/* checks the snapshot's smoke can be restored, without restoring it */
+int volume_check(const snapshot_t *s) {
+	const void *saved[FIELDS + 1];
+
+	return volume_find(s, saved);
+}
+
+/* restores the smoke from a snapshot, or clears it if the snapshot has
+ * none.  The grid must have been allocated.  Returns 0 if the snapshot's
+ * smoke is damaged, leaving the grid cleared. */
+int volume_restore(const snapshot_t *s) {
+	const void *saved[FIELDS + 1];
+	int f;
+
+	volume_clear();
+	if ( !volume_find(s, saved) )
+		return 0;
+	if ( !saved[0] )
+		return 1;
+	for(f=0; f<FIELDS; f++)
+		memcpy(fields[current][f], saved[f], sizeof(float) * VOLUME_CELLS);
+	memcpy(opacity, saved[FIELDS], VOLUME_CELLS);
+	return 1;
+}
@@ -0,0 +1,47 @@
+/************************************************************************** 
+ * Nanobot:  A simple, interactive robot rendered using OpenGL
+ * Copyright (C) 2007, Corey Edmunds (corey.edmunds@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *************************************************************************/
+
+
+/**************************************************************************
+ * volume.c/h
+ *
+ * Volumetric smoke: density and velocity on a fixed 3D grid around the
+ * robot, instead of particles.  The emitters pour density and velocity
+ * in, and each tick both are carried along the velocity with a 
+ * semi-Lagrangian step (each cell looks back along its velocity and 
+ * takes what was there), one slab of the grid per worker job.  It is 
+ * drawn as a stack of textured slices through a 3D texture, so the cost
+ * is set by the grid size and not by how much smoke there is.
+ *************************************************************************/
+#ifndef __VOLUME_H
+#define __VOLUME_H
+#include "snapshot.h"
+
+/* the grid is VOLUME_SIZE cells along each side */
+#define VOLUME_SIZE 32
+
+int init_volume(void);
+void volume_clear(void);
+void volume_inject(const float *pos, const float *vel, float amount);
+void volume_think(float lift, float ground);
+void volume_render(const float *color);
+void volume_save(snapshot_writer *w);
+int volume_check(const snapshot_t *s);
+int volume_restore(const snapshot_t *s);
+#endif
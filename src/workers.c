@@ -0,0 +1,133 @@
+/************************************************************************** 
+ * Nanobot:  A simple, interactive robot rendered using OpenGL
+ * Copyright (C) 2007, Corey Edmunds (corey.edmunds@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *************************************************************************/
+
+
+/**************************************************************************
+ * workers.c/h
+ *
+ * A small pool of worker threads.  workers_run() hands out numbered jobs
+ * to the pool (and the calling thread) and returns when all of them are
+ * done.  Jobs must not touch GL; only the main thread owns the context.
+ *************************************************************************/
+#include "workers.h"
+#include <pthread.h>
+#include <unistd.h>
+#include <stdio.h>
+
+#define MAX_WORKERS 64
+
+/* the threads in the pool, not counting the main thread */
+static pthread_t threads[MAX_WORKERS];
+static int thread_count;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t start = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done = PTHREAD_COND_INITIALIZER;
+
+/* the batch being run.  generation is bumped to start a batch, and busy
+ * counts the pool threads that have not finished it yet. */
+static worker_job batch_job;
+static void *batch_arg;
+static int batch_jobs;
+static int batch_next;
+static int generation;
+static int busy;
+
+/* runs jobs from the current batch until there are none left */
+static void run_jobs(void) {
+	int n;
+
+	while ( (n = __sync_fetch_and_add(&batch_next, 1)) < batch_jobs )
+		batch_job(n, batch_arg);
+}
+
+static void *worker_main(void *arg) {
+	int seen = 0;
+
+	if ( arg ) arg = arg; /* shut up compiler */
+	for(;;) {
+		pthread_mutex_lock(&lock);
+		while ( generation == seen )
+			pthread_cond_wait(&start, &lock);
+		seen = generation;
+		pthread_mutex_unlock(&lock);
+
+		run_jobs();
+
+		pthread_mutex_lock(&lock);
+		if ( --busy == 0 )
+			pthread_cond_signal(&done);
+		pthread_mutex_unlock(&lock);
+	}
+	return NULL;
+}
+
+/* starts the pool.  count is the total number of threads to run jobs on,
+ * including the caller; 0 picks one per online CPU. */
+void init_workers(int count) {
+	int i;
+
+	if ( count <= 0 )
+		count = sysconf(_SC_NPROCESSORS_ONLN);
+	if ( count > MAX_WORKERS + 1 )
+		count = MAX_WORKERS + 1;
+
+	for(i=0; i<count-1; i++) {
+		if ( pthread_create(&threads[i], NULL, worker_main, NULL) ) {
+			printf("%s %d:  Could not start worker %d\n", 
+				__FILE__, __LINE__, i);
+			break;
+		}
+		pthread_detach(threads[i]);
+	}
+	thread_count = i;
+}
+
+/* the number of threads jobs are run on, including the caller */
+int workers_count(void) {
+	return thread_count + 1;
+}
+
+/* runs jobs [0, jobs) across the pool and waits for them to finish */
+void workers_run(int jobs, worker_job job, void *arg) {
+	int n;
+
+	if ( thread_count == 0 || jobs <= 1 ) {
+		for(n=0; n<jobs; n++)
+			job(n, arg);
+		return;
+	}
+
+	pthread_mutex_lock(&lock);
+	batch_job = job;
+	batch_arg = arg;
+	batch_jobs = jobs;
+	batch_next = 0;
+	busy = thread_count;
+	generation++;
+	pthread_cond_broadcast(&start);
+	pthread_mutex_unlock(&lock);
+
+	run_jobs();
+
+	pthread_mutex_lock(&lock);
+	while ( busy )
+		pthread_cond_wait(&done, &lock);
+	pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,37 @@
+/************************************************************************** 
+ * Nanobot:  A simple, interactive robot rendered using OpenGL
+ * Copyright (C) 2007, Corey Edmunds (corey.edmunds@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ *************************************************************************/
+
+
+/**************************************************************************
+ * workers.c/h
+ *
+ * A small pool of worker threads.  workers_run() hands out numbered jobs
+ * to the pool (and the calling thread) and returns when all of them are
+ * done.  Jobs must not touch GL; only the main thread owns the context.
+ *************************************************************************/
+#ifndef __WORKERS_H
+#define __WORKERS_H
+
+/* a job function; n is the job number */
+typedef void (*worker_job)(int n, void *arg);
+
+void init_workers(int count);
+int workers_count(void);
+void workers_run(int jobs, worker_job job, void *arg);
+#endif